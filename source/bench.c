@@ -0,0 +1,564 @@
+/*
+ * File: bench.c
+ * Purpose: This file contains an open-loop load generator for sws.  It
+ *          replays hydra test scripts, or sends requests at a constant or
+ *          Poisson arrival rate, and reports the throughput and latency
+ *          percentiles of each response size class.
+ *
+ *          Requests are sent at the times the script or arrival process
+ *          asks for, whether or not earlier responses have come back, and
+ *          latency is measured from that time.  A slow server therefore
+ *          shows up as latency instead of a lower request rate.  Each
+ *          thread drives its own share of the connections from an epoll
+ *          loop, with one connection per request, like hydra.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+
+#define USAGE "usage: bench [-t threads] [-h host] [-r rate [-a constant|poisson]\n" \
+              "              [-d seconds] [-n requests] [-s seed]] [<port> <file> ...]\n" \
+              "       without files, a hydra test script is read from stdin\n"
+
+#define MAX_EVENTS 256                  /* events per epoll_wait() */
+#define DRAIN_TIMEOUT 10.0              /* seconds to wait for stragglers */
+#define CLASSES 5                       /* response size classes */
+
+typedef struct arrival {
+  double delay;                         /* seconds from start to connect */
+  double pause;                         /* seconds from connect to send */
+  char *file;                           /* file to request */
+} arrival;
+
+typedef struct request {
+  int fd;                               /* connection to the server */
+  double send_at;                       /* when the request is due */
+  char *file;                           /* file to request */
+  int sent;                             /* 1 once the request is written */
+  int status;                           /* status code of the response */
+  long received;                        /* bytes of response read */
+  long body;                            /* offset of the body, -1 until known */
+  int head_len;                         /* bytes in head */
+  char head[256];                       /* start of the response */
+} request;
+
+typedef struct samples {
+  double *v;                            /* latencies in seconds */
+  long n;
+  long cap;
+} samples;
+
+typedef struct worker {
+  pthread_t thread;
+  int id;
+  arrival *script;                      /* this worker's part of the script */
+  long nscript;
+  double rate;                          /* this worker's requests per second */
+  double phase;                         /* time of the first arrival */
+  long quota;                           /* requests to send, -1 for no limit */
+  unsigned int seed;                    /* for rand_r() */
+  samples classes[CLASSES];             /* latencies by response size */
+  long completed;                       /* responses read to the end */
+  long failed;                          /* connection errors and timeouts */
+  long errors;                          /* responses with status >= 400 */
+  long bytes;                           /* bytes of responses */
+  double finished;                      /* when the last response ended */
+} worker;
+
+static const char *class_names[CLASSES] = {
+  "0-1K", "1K-16K", "16K-256K", "256K-4M", "4M+"
+};
+static const long class_limits[CLASSES] = {
+  1L << 10, 16L << 10, 256L << 10, 4L << 20, -1
+};
+
+static struct sockaddr_in server;       /* address of sws */
+static double started;                  /* when the run started */
+static double duration = 10.0;          /* seconds of generated requests */
+static int poisson = 1;                 /* Poisson or constant arrivals */
+static char **files;                    /* files to request at random */
+static int nfiles;
+
+
+/* This function reads the monotonic clock.
+ * Parameters: None
+ * Returns: The time in seconds since an arbitrary point.
+ */
+static double now() {
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/* This function appends a latency to a set of samples.
+ * Parameters:
+ *             s : the samples
+ *             v : the latency
+ * Returns: None
+ */
+static void sample( samples *s, double v ) {
+  if( s->n == s->cap ) {
+    s->cap = s->cap ? s->cap * 2 : 1024;
+    s->v = realloc( s->v, s->cap * sizeof( double ) );
+    if( !s->v ) {
+      perror( "Error while allocating memory" );
+      abort();
+    }
+  }
+  s->v[s->n++] = v;
+}
+
+
+/* This function computes the time of the next arrival of a worker.
+ * Parameters:
+ *             w    : the worker
+ *             i    : the number of the arrival
+ *             prev : the time of the previous arrival
+ * Returns: The time of the arrival in seconds from the start, or -1 if the
+ *          worker has no more arrivals.
+ */
+static double next_arrival( worker *w, long i, double prev ) {
+  double at;
+
+  if( w->script ) {
+    return i < w->nscript ? w->script[i].delay : -1;
+  }
+  if( w->quota >= 0 && i >= w->quota ) {
+    return -1;
+  }
+  if( !poisson ) {                                      /* evenly spaced */
+    at = i ? prev + 1 / w->rate : w->phase;
+  } else {                                              /* exponential gaps */
+    at = prev - log( 1 - rand_r( &w->seed ) / ( RAND_MAX + 1.0 ) ) / w->rate;
+  }
+  return at < duration ? at : -1;
+}
+
+
+/* This function connects to the server for a new request.
+ * Parameters:
+ *             w    : the worker
+ *             epfd : the worker's epoll instance
+ *             file : the file to request
+ *             at   : when the request is due
+ * Returns: 1 if the request is outstanding, 0 if it failed.
+ */
+static int start( worker *w, int epfd, char *file, double at ) {
+  request *r = calloc( 1, sizeof( request ) );
+  struct epoll_event ev;
+
+  r->fd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0 );
+  r->send_at = at;
+  r->file = file;
+  r->body = -1;
+  ev.events = EPOLLOUT;
+  ev.data.ptr = r;
+
+  if( r->fd < 0
+      || ( connect( r->fd, (struct sockaddr *)&server, sizeof( server ) ) < 0
+           && errno != EINPROGRESS )
+      || epoll_ctl( epfd, EPOLL_CTL_ADD, r->fd, &ev ) < 0 ) {
+    if( r->fd >= 0 ) {
+      close( r->fd );
+    }
+    free( r );
+    w->failed++;
+    return 0;
+  }
+  return 1;
+}
+
+
+/* This function ends a request, recording its latency if it succeeded.
+ * Parameters:
+ *             w  : the worker
+ *             r  : the request
+ *             ok : 1 if the whole response was read
+ * Returns: None
+ */
+static void finish( worker *w, request *r, int ok ) {
+  double t = now() - started;
+  long size = r->body >= 0 ? r->received - r->body : 0;
+  int c;
+
+  if( ok && r->body >= 0 ) {
+    for( c = 0; c < CLASSES - 1 && size >= class_limits[c]; c++ );
+    sample( &w->classes[c], t - r->send_at );
+    w->completed++;
+    w->bytes += r->received;
+    w->errors += r->status >= 400;
+    w->finished = t;
+  } else {
+    w->failed++;
+  }
+  close( r->fd );
+  free( r );
+}
+
+
+/* This function writes the request once the connection is up and the
+ *    request is due.
+ * Parameters:
+ *             w    : the worker
+ *             epfd : the worker's epoll instance
+ *             r    : the request
+ * Returns: 1 if the request is still outstanding, 0 if it failed.
+ */
+static int send_request( worker *w, int epfd, request *r ) {
+  char buf[512];
+  struct epoll_event ev;
+  int len = snprintf( buf, sizeof( buf ),
+                      "GET /%s HTTP/1.1\r\nHost: localhost\r\n"
+                      "Connection: close\r\n\r\n", r->file );
+
+  ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.ptr = r;
+  r->sent = 1;
+  if( write( r->fd, buf, len ) < len
+      || epoll_ctl( epfd, EPOLL_CTL_MOD, r->fd, &ev ) < 0 ) {
+    finish( w, r, 0 );
+    return 0;
+  }
+  return 1;
+}
+
+
+/* This function reads what the server has sent on a connection.
+ * Parameters:
+ *             w : the worker
+ *             r : the request
+ * Returns: 1 if the request is still outstanding, 0 if it ended.
+ */
+static int receive( worker *w, request *r ) {
+  static __thread char buf[65536];                      /* discarded body */
+  char *end;
+  int n, copy;
+
+  for( ;; ) {
+    n = read( r->fd, buf, sizeof( buf ) );
+    if( n == 0 ) {                                      /* server is done */
+      finish( w, r, 1 );
+      return 0;
+    } else if( n < 0 ) {
+      if( errno == EAGAIN || errno == EINTR ) {
+        return 1;
+      }
+      finish( w, r, 0 );
+      return 0;
+    }
+
+    if( r->body < 0 ) {                                 /* still in header */
+      copy = sizeof( r->head ) - 1 - r->head_len;
+      copy = n < copy ? n : copy;
+      memcpy( r->head + r->head_len, buf, copy );
+      r->head_len += copy;
+      r->head[r->head_len] = '\0';
+      if( ( end = strstr( r->head, "\r\n\r\n" ) ) ) {
+        r->body = end + 4 - r->head;
+        sscanf( r->head, "HTTP/%*s %d", &r->status );
+      }
+    }
+    r->received += n;
+  }
+}
+
+
+/* This function is the main loop of a worker thread.  It starts each
+ *    request when it is due, and waits on epoll for connections, responses,
+ *    and the next request.
+ * Parameters:
+ *             arg : the worker
+ * Returns: NULL
+ */
+static void *run( void *arg ) {
+  worker *w = arg;
+  struct epoll_event events[MAX_EVENTS];
+  request **paused = NULL;                              /* connected, not due */
+  long npaused = 0;
+  long outstanding = 0;                                 /* requests in flight */
+  long i = 0;                                           /* arrivals started */
+  double at = next_arrival( w, 0, 0 );                  /* next arrival */
+  double t, wake, last = 0;
+  int epfd = epoll_create1( 0 );
+  int n, k, err;
+  socklen_t len;
+  request *r;
+
+  for( ;; ) {
+    t = now() - started;
+    while( at >= 0 && at <= t ) {                       /* start due arrivals */
+      if( w->script ) {
+        outstanding += start( w, epfd, w->script[i].file,
+                              at + w->script[i].pause );
+      } else {
+        outstanding += start( w, epfd, files[rand_r( &w->seed ) % nfiles], at );
+      }
+      last = at;
+      at = next_arrival( w, ++i, at );
+    }
+
+    wake = at;                                          /* next thing to do */
+    for( k = 0; k < npaused; k++ ) {                    /* send due requests */
+      r = paused[k];
+      if( r->send_at <= t ) {
+        paused[k--] = paused[--npaused];
+        outstanding -= !send_request( w, epfd, r );
+      } else if( wake < 0 || r->send_at < wake ) {
+        wake = r->send_at;
+      }
+    }
+
+    if( at < 0 && outstanding == 0 ) {
+      break;
+    } else if( at < 0 && t > last + DRAIN_TIMEOUT ) {   /* give up on them */
+      w->failed += outstanding;
+      break;
+    }
+
+    k = wake < 0 ? 100 : (int)ceil( ( wake - t ) * 1000 );
+    n = epoll_wait( epfd, events, MAX_EVENTS, k );
+    for( k = 0; k < n; k++ ) {
+      r = events[k].data.ptr;
+      if( r->sent ) {
+        outstanding -= !receive( w, r );
+        continue;
+      }
+
+      len = sizeof( err );                              /* connected? */
+      if( getsockopt( r->fd, SOL_SOCKET, SO_ERROR, &err, &len ) < 0 || err ) {
+        finish( w, r, 0 );
+        outstanding--;
+      } else if( r->send_at > now() - started ) {       /* pause first */
+        events[k].events = 0;
+        epoll_ctl( epfd, EPOLL_CTL_MOD, r->fd, &events[k] );
+        paused = realloc( paused, sizeof( request * ) * ( npaused + 1 ) );
+        paused[npaused++] = r;
+      } else {
+        outstanding -= !send_request( w, epfd, r );
+      }
+    }
+  }
+
+  free( paused );
+  close( epfd );
+  return NULL;
+}
+
+
+/* This function compares two latencies for qsort().
+ */
+static int compare( const void *a, const void *b ) {
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return ( x > y ) - ( x < y );
+}
+
+
+/* This function prints the count and percentiles of a set of latencies.
+ * Parameters:
+ *             name : the name of the size class
+ *             s    : the latencies, which are sorted
+ * Returns: None
+ */
+static void print_class( const char *name, samples *s ) {
+  static const double points[] = { 0.5, 0.9, 0.99, 0.999 };
+  int i;
+
+  printf( "%-12s %10ld", name, s->n );
+  for( i = 0; i < 4; i++ ) {
+    printf( " %10.3f", s->n ? s->v[(long)ceil( points[i] * s->n ) - 1] * 1000 : 0 );
+  }
+  printf( "\n" );
+}
+
+
+/* This function reads a hydra test script from stdin: a port number,
+ *    followed by one "delay pause file" line per request.
+ * Parameters:
+ *             port : set to the port number
+ *             n    : set to the number of requests
+ * Returns: The requests, or NULL if the script is malformed.
+ */
+static arrival *read_script( int *port, long *n ) {
+  char line[1024];
+  char file[512];
+  arrival *script = NULL;
+  arrival a;
+  long cap = 0;
+
+  *n = 0;
+  if( !fgets( line, sizeof( line ), stdin ) || sscanf( line, "%d", port ) < 1 ) {
+    return NULL;
+  }
+  while( fgets( line, sizeof( line ), stdin ) ) {
+    if( sscanf( line, "%lf %lf %511s", &a.delay, &a.pause, file ) < 3 ) {
+      continue;                                         /* hydra skips these */
+    }
+    if( *n == cap ) {
+      cap = cap ? cap * 2 : 64;
+      script = realloc( script, cap * sizeof( arrival ) );
+    }
+    a.file = strdup( file );
+    script[( *n )++] = a;
+  }
+  return script;
+}
+
+
+/* This function compares two arrivals by connect time for qsort().
+ */
+static int compare_arrivals( const void *a, const void *b ) {
+  return compare( &( (const arrival *)a )->delay, &( (const arrival *)b )->delay );
+}
+
+
+int main( int argc, char **argv ) {
+  int threads = 1;                                      /* # of workers */
+  char *host = "localhost";                             /* server host */
+  double rate = 0;                                      /* requests per sec */
+  long requests = -1;                                   /* -n limit */
+  unsigned int seed = 1;                                /* for rand_r() */
+  arrival *script = NULL;                               /* script requests */
+  long nscript = 0;
+  int port = -1;
+  int opt, i, c;
+  long k;
+  struct addrinfo hints, *res;
+  struct rlimit nofile;
+  worker *workers;
+  samples all = { 0 }, merged;
+  long completed = 0, failed = 0, errors = 0, bytes = 0;
+  double elapsed = 0;
+
+  while( ( opt = getopt( argc, argv, "t:h:r:a:d:n:s:" ) ) != -1 ) {
+    switch( opt ) {
+    case 't': threads = atoi( optarg ); break;
+    case 'h': host = optarg; break;
+    case 'r': rate = atof( optarg ); break;
+    case 'a': poisson = strcmp( optarg, "constant" ) != 0; break;
+    case 'd': duration = atof( optarg ); break;
+    case 'n': requests = atol( optarg ); break;
+    case 's': seed = strtoul( optarg, NULL, 10 ); break;
+    default:
+      printf( USAGE );
+      return 1;
+    }
+  }
+  if( threads < 1 || rate < 0 || ( optind < argc && argc - optind < 2 ) ) {
+    printf( USAGE );
+    return 1;
+  }
+
+  if( optind < argc ) {                                 /* port and files */
+    port = atoi( argv[optind] );
+    files = argv + optind + 1;
+    nfiles = argc - optind - 1;
+    if( rate <= 0 ) {
+      printf( "Error: requests for files need an arrival rate, see -r\n" );
+      return 1;
+    }
+  } else {                                              /* hydra script */
+    if( !( script = read_script( &port, &nscript ) ) ) {
+      printf( "Error: malformed test script\n" );
+      return 1;
+    }
+    if( rate > 0 ) {                                    /* just the file mix */
+      files = malloc( nscript * sizeof( char * ) );
+      for( k = 0; k < nscript; k++ ) {
+        files[k] = script[k].file;
+      }
+      nfiles = nscript;
+      script = NULL;
+    } else {
+      qsort( script, nscript, sizeof( arrival ), compare_arrivals );
+    }
+  }
+
+  memset( &hints, 0, sizeof( hints ) );
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if( getaddrinfo( host, NULL, &hints, &res ) ) {
+    printf( "Error: unknown host %s\n", host );
+    return 1;
+  }
+  server = *(struct sockaddr_in *)res->ai_addr;
+  server.sin_port = htons( port );
+  freeaddrinfo( res );
+
+  getrlimit( RLIMIT_NOFILE, &nofile );                  /* one fd per request */
+  nofile.rlim_cur = nofile.rlim_max;
+  setrlimit( RLIMIT_NOFILE, &nofile );
+
+  workers = calloc( threads, sizeof( worker ) );
+  started = now();
+  for( i = 0; i < threads; i++ ) {
+    workers[i].id = i;
+    if( script ) {                                      /* deal out the script */
+      workers[i].script = malloc( ( nscript / threads + 1 ) * sizeof( arrival ) );
+      for( k = i; k < nscript; k += threads ) {
+        workers[i].script[workers[i].nscript++] = script[k];
+      }
+    } else {                                            /* split rate, limit */
+      workers[i].rate = rate / threads;
+      workers[i].phase = poisson ? 0 : i / rate;        /* interleave them */
+      workers[i].quota = requests < 0 ? -1
+                         : requests / threads + ( i < requests % threads );
+    }
+    workers[i].seed = seed + i;
+    if( pthread_create( &workers[i].thread, NULL, run, &workers[i] ) ) {
+      printf( "Error: could not start thread %d\n", i );
+      return 1;
+    }
+  }
+
+  printf( "%-12s %10s %10s %10s %10s %10s\n",
+          "size", "requests", "p50 ms", "p90 ms", "p99 ms", "p999 ms" );
+  for( i = 0; i < threads; i++ ) {
+    pthread_join( workers[i].thread, NULL );
+  }
+  for( c = 0; c < CLASSES; c++ ) {                      /* merge the workers */
+    memset( &merged, 0, sizeof( merged ) );
+    for( i = 0; i < threads; i++ ) {
+      for( k = 0; k < workers[i].classes[c].n; k++ ) {
+        sample( &merged, workers[i].classes[c].v[k] );
+        sample( &all, workers[i].classes[c].v[k] );
+      }
+    }
+    qsort( merged.v, merged.n, sizeof( double ), compare );
+    if( merged.n ) {
+      print_class( class_names[c], &merged );
+    }
+    free( merged.v );
+  }
+  qsort( all.v, all.n, sizeof( double ), compare );
+  print_class( "all", &all );
+
+  for( i = 0; i < threads; i++ ) {
+    completed += workers[i].completed;
+    failed += workers[i].failed;
+    errors += workers[i].errors;
+    bytes += workers[i].bytes;
+    elapsed = workers[i].finished > elapsed ? workers[i].finished : elapsed;
+  }
+  printf( "\ncompleted:  %ld (%ld with status >= 400)\nfailed:     %ld\n",
+          completed, errors, failed );
+  printf( "throughput: %.1f req/s, %.2f MB/s over %.3f s\n",
+          elapsed > 0 ? completed / elapsed : 0,
+          elapsed > 0 ? bytes / elapsed / ( 1 << 20 ) : 0, elapsed );
+  return failed > 0;
+}
@@ -0,0 +1,189 @@
+/* 
+ * File: cache.c
+ * Purpose: This file contains the in-memory content cache.
+ *          Please see cache.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "cache.h"
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static lru_table table;                     /* entries by path and recency */
+static long used = 0;                       /* bytes held by entries */
+static long limit = 0;                      /* capacity of the cache */
+static long largest = 0;                    /* largest file to cache */
+
+
+/* This function frees an entry. */
+static void destroy( cache_entry *e ) {
+  free( e->data );
+  free( e->node.key );
+  free( e );
+}
+
+
+/* This function removes an entry from the cache, and frees it if it has no
+ *    users.  Lock must be held.
+ */
+static void evict( cache_entry *e ) {
+  lru_remove( &table, &e->node );
+  used -= e->size;
+  e->cached = 0;
+  if( e->refs == 0 ) {
+    destroy( e );
+  }
+}
+
+
+/* This function returns the time in seconds, from a clock that never jumps.
+ */
+static time_t now( void ) {
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC_COARSE, &ts );
+  return ts.tv_sec;
+}
+
+
+/* This function checks if the file of an entry has changed since it was
+ *    loaded.  When the open file cache is enabled it knows the status of
+ *    the file without a system call, so it is asked every time; otherwise
+ *    the file is stat()ed at most once every CACHE_REVALIDATE seconds.
+ * Parameters:
+ *             e    : a referenced entry
+ *             path : the path of the file
+ * Returns: 1 if the entry is stale, 0 otherwise.
+ */
+static int stale( cache_entry *e, const char *path ) {
+  fdcache_entry *file;
+  struct stat st;
+  time_t t;
+  int changed;
+
+  if( fdcache_enabled() ) {
+    file = fdcache_get( path );
+    if( !file ) {                                       /* file is gone */
+      return 1;
+    }
+    changed = ( file->st.st_size != e->size )
+              || ( file->st.st_mtim.tv_sec != e->mtime.tv_sec )
+              || ( file->st.st_mtim.tv_nsec != e->mtime.tv_nsec );
+    fdcache_release( file );
+    return changed;
+  }
+
+  t = now();
+  if( t - e->checked < CACHE_REVALIDATE ) {
+    return 0;
+  }
+  if( stat( path, &st ) || ( st.st_size != e->size )
+      || ( st.st_mtim.tv_sec != e->mtime.tv_sec )
+      || ( st.st_mtim.tv_nsec != e->mtime.tv_nsec ) ) {
+    return 1;
+  }
+  e->checked = t;
+  return 0;
+}
+
+
+extern void cache_init( long capacity, long max_object ) {
+  limit = capacity;
+  largest = max_object < capacity ? max_object : capacity;
+}
+
+
+extern cache_entry *cache_get( const char *path, fdcache_entry **file ) {
+  cache_entry *e = NULL;                                /* entry for path */
+  cache_entry *dup;                                     /* entry added by */
+  struct stat *st;                                      /* another thread */
+
+  *file = NULL;
+  if( limit > 0 ) {                                     /* look up the path */
+    pthread_mutex_lock( &lock );
+    e = (cache_entry *)lru_find( &table, path );
+    if( e ) {
+      e->refs++;
+    }
+    pthread_mutex_unlock( &lock );
+  }
+
+  if( e && stale( e, path ) ) {                         /* file changed */
+    pthread_mutex_lock( &lock );
+    if( e->cached ) {
+      evict( e );
+    }
+    pthread_mutex_unlock( &lock );
+    cache_release( e );
+    e = NULL;
+  }
+
+  if( e ) {                                             /* cache hit */
+    pthread_mutex_lock( &lock );
+    if( e->cached ) {
+      lru_touch( &table, &e->node );
+    }
+    pthread_mutex_unlock( &lock );
+    return e;
+  }
+
+  *file = fdcache_get( path );                          /* cache miss */
+  if( !*file ) {
+    return NULL;
+  }
+  st = &( *file )->st;
+
+  if( ( st->st_size > largest ) || ( limit <= 0 ) ) {
+    return NULL;                                        /* not cacheable */
+  }
+
+  e = calloc( 1, sizeof( cache_entry ) );
+  if( !e ) {
+    return NULL;
+  }
+  e->node.key = strdup( path );
+  e->data = lru_load( ( *file )->fd, st->st_size );
+  if( !e->node.key || !e->data ) {
+    destroy( e );
+    return NULL;
+  }
+  e->size = st->st_size;
+  e->mtime = st->st_mtim;
+  e->checked = now();
+  e->header = ( *file )->header;
+  e->refs = 1;
+  e->cached = 1;
+  fdcache_release( *file );
+  *file = NULL;
+
+  pthread_mutex_lock( &lock );
+  dup = (cache_entry *)lru_find( &table, path );
+  if( dup ) {                                           /* lost the race */
+    evict( dup );
+  }
+  while( table.lru && ( used + e->size > limit ) ) {    /* make room */
+    evict( (cache_entry *)table.lru );
+  }
+  lru_insert( &table, &e->node );
+  used += e->size;
+  pthread_mutex_unlock( &lock );
+  return e;
+}
+
+
+extern void cache_release( cache_entry *e ) {
+  int gone;
+
+  pthread_mutex_lock( &lock );
+  e->refs--;
+  gone = ( e->refs == 0 ) && !e->cached;
+  pthread_mutex_unlock( &lock );
+
+  if( gone ) {
+    destroy( e );
+  }
+}
@@ -0,0 +1,83 @@
+/* 
+ * File: cache.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          in-memory content cache, which keeps the bodies of small, hot
+ *          files so they can be sent without touching the file system.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "header.h"
+#include "fdcache.h"
+#include "lru.h"
+
+/* 
+ * This module has three functions:
+ *   cache_init()    : inititalizes the cache
+ *   cache_get()     : look up a file, loading it into the cache on a miss
+ *   cache_release() : release an entry returned by cache_get()
+ *
+ * The cache is bounded by the total number of bytes of the bodies it holds.
+ * When it is full, the least recently used entries are evicted.  A hit is
+ * checked against the size and modification time of the file.  These come
+ * from the open file cache, which inotify keeps up to date, or if it is
+ * disabled from stat() at most once every CACHE_REVALIDATE seconds, so a
+ * hit normally costs no system calls at all.  Only a miss opens the file.
+ * The module is thread safe.
+ */
+
+#define CACHE_REVALIDATE 1              /* seconds between revalidations */
+
+typedef struct cache_entry {
+  lru_node node;                        /* path and links, must be first */
+  char *data;                           /* the body of the file */
+  off_t size;                           /* number of bytes in data */
+  struct timespec mtime;                /* modification time of the file */
+  time_t checked;                       /* when the file was last checked */
+  file_header header;                   /* response headers of the file */
+  int refs;                             /* number of users of the entry */
+  int cached;                           /* 0 once evicted or invalidated */
+} cache_entry;
+
+
+/* This function initializes the cache.  It should be called once, before
+ *    any other function of this module.
+ * Parameters: 
+ *             capacity   : the maximum number of bytes to cache, 0 to
+ *                          disable the cache
+ *             max_object : the size of the largest file to cache
+ * Returns: None
+ */
+extern void cache_init( long capacity, long max_object );
+
+
+/* This function looks up a file in the cache.  On a miss the file is looked
+ *    up in the open file cache, and if it is small enough its body is read
+ *    into the cache.  Otherwise the open file is handed back to the caller,
+ *    so the file is never opened twice.
+ * Parameters: 
+ *             path : the normalized path of the file
+ *             file : set to NULL on a hit, otherwise to the open file, which
+ *                    the caller must pass to fdcache_release(), or to NULL
+ *                    if the file could not be opened
+ * Returns: A referenced entry holding the body of the file, or NULL if the
+ *          file is not cached.  The entry must be passed to cache_release()
+ *          when the caller is done with it.
+ */
+extern cache_entry *cache_get( const char *path, fdcache_entry **file );
+
+
+/* This function releases an entry returned by cache_get().  The entry is
+ *    freed once it is no longer cached and has no more users.
+ * Parameters: 
+ *             e : the entry
+ * Returns: None
+ */
+extern void cache_release( cache_entry *e );
+
+#endif
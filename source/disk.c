@@ -0,0 +1,108 @@
+/*
+ * File: disk.c
+ * Purpose: This file contains the disk pool.
+ *          Please see disk.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "disk.h"
+#include "network.h"
+
+typedef struct job_list {
+  disk_job *head;
+  disk_job *tail;
+} job_list;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;
+static job_list jobs;                       /* jobs waiting for a thread */
+static job_list *done;                      /* jobs that have run, by shard */
+
+
+/* This function appends a job to a list.  The lock must be held.
+ * Returns: Non-zero if the list was empty.
+ */
+static int append( job_list *l, disk_job *j ) {
+  int empty = !l->head;
+
+  j->next = NULL;
+  if( l->tail ) {
+    l->tail->next = j;
+  } else {
+    l->head = j;
+  }
+  l->tail = j;
+  return empty;
+}
+
+
+/* This function is the main loop of a pool thread.  It runs jobs as they
+ *    are queued, and hands each one back to its shard.
+ */
+static void *worker( void *arg ) {
+  disk_job *j;
+  int wake;
+
+  for( ;; ) {
+    pthread_mutex_lock( &lock );
+    while( !jobs.head ) {
+      pthread_cond_wait( &queued, &lock );
+    }
+    j = jobs.head;
+    jobs.head = j->next;
+    if( !jobs.head ) {
+      jobs.tail = NULL;
+    }
+    pthread_mutex_unlock( &lock );
+
+    j->run( j );
+
+    pthread_mutex_lock( &lock );
+    wake = append( &done[j->shard], j );
+    pthread_mutex_unlock( &lock );
+    if( wake ) {                                        /* later ones are */
+      network_wake( j->shard );                         /* picked up with it */
+    }
+  }
+  return NULL;
+}
+
+
+extern int disk_init( int threads, int shards ) {
+  pthread_t thread;
+  int started = 0;
+
+  done = calloc( shards, sizeof( job_list ) );
+  if( !done ) {
+    perror( "Error while allocating memory" );
+    abort();
+  }
+  for( ; threads > 0; threads-- ) {
+    if( !pthread_create( &thread, NULL, worker, NULL ) ) {
+      started++;
+    }
+  }
+  return started > 0 ? 0 : -1;
+}
+
+
+extern void disk_submit( disk_job *j ) {
+  pthread_mutex_lock( &lock );
+  append( &jobs, j );
+  pthread_cond_signal( &queued );
+  pthread_mutex_unlock( &lock );
+}
+
+
+extern disk_job *disk_done( int shard ) {
+  disk_job *j;
+
+  pthread_mutex_lock( &lock );
+  j = done[shard].head;
+  done[shard].head = done[shard].tail = NULL;
+  pthread_mutex_unlock( &lock );
+  return j;
+}
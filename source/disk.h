@@ -0,0 +1,63 @@
+/*
+ * File: disk.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          disk pool, a set of threads that do the blocking file system
+ *          work of requests, so the threads that serve clients never wait
+ *          for the disk.
+ */
+
+#ifndef DISK_H
+#define DISK_H
+
+/*
+ * This module has three functions:
+ *   disk_init()   : start the threads of the pool
+ *   disk_submit() : hand a job to the pool
+ *   disk_done()   : take the jobs of a shard that have run
+ *
+ * A job is embedded in the object it belongs to, like a timer, and names
+ * the function to run on a pool thread and the network shard it came from.
+ * Jobs are started in the order they are submitted, by the first free
+ * thread.  Once a job has run it is put on its shard's list of finished
+ * jobs, and network_wake() makes the poll of the shard return, so the
+ * thread polling the shard goes on with the job after disk_done().  Only
+ * the first job to finish after a disk_done() wakes the shard.  The module
+ * is thread safe.
+ */
+
+typedef struct disk_job {
+  struct disk_job *next;                /* next job of its queue or list */
+  void (*run)( struct disk_job *j );    /* work to do on a pool thread */
+  int shard;                            /* shard to hand it back to */
+  void *owner;                          /* the object the job belongs to */
+} disk_job;
+
+
+/* This function starts the threads of the pool.  It should be called once,
+ *    after the network module is initialized.
+ * Parameters:
+ *             threads : the number of threads
+ *             shards  : the number of network shards
+ * Returns: 0 on success, -1 if no thread could be started, in which case
+ *          jobs must not be submitted.
+ */
+extern int disk_init( int threads, int shards );
+
+
+/* This function queues a job for the pool.
+ * Parameters:
+ *             j : the job, with run, shard and owner set
+ * Returns: None
+ */
+extern void disk_submit( disk_job *j );
+
+
+/* This function takes the jobs of a shard that have run.
+ * Parameters:
+ *             shard : the shard
+ * Returns: The jobs in the order they finished, linked by next, or NULL if
+ *          there are none.
+ */
+extern disk_job *disk_done( int shard );
+
+#endif
@@ -0,0 +1,372 @@
+/*
+ * File: fdcache.c
+ * Purpose: This file contains the open file cache.
+ *          Please see fdcache.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+
+#include "fdcache.h"
+
+#define WATCH_EVENTS ( IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE \
+                       | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF )
+#define GONE_EVENTS ( IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED )
+
+typedef struct watch {
+  lru_node node;                            /* directory, "" for the top */
+  int wd;                                   /* inotify watch descriptor */
+} watch;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static lru_table table;                     /* entries by path and recency */
+static int limit = 0;                       /* most files to keep open */
+static int notify = -1;                     /* the inotify instance */
+static lru_table dirs;                      /* watched directories by path */
+static watch **wds = NULL;                  /* watched directories by wd */
+static int nwds = 0;
+static unsigned long changes = 0;           /* events seen so far */
+
+
+/* This function closes the file of an entry and frees it.
+ */
+static void destroy( fdcache_entry *e ) {
+  close( e->fd );
+  free( e->node.key );
+  free( e );
+}
+
+
+/* This function removes an entry from the cache, and frees it unless it is
+ *    still in use.  The lock must be held.
+ */
+static void evict( fdcache_entry *e ) {
+  lru_remove( &table, &e->node );
+  e->cached = 0;
+  if( e->refs == 0 ) {
+    destroy( e );
+  }
+}
+
+
+/* This function checks if a path is a directory or lies below it.
+ * Parameters:
+ *             path : the path
+ *             dir  : the directory, "" for the top
+ * Returns: 1 if it is, 0 otherwise.
+ */
+static int below( const char *path, const char *dir ) {
+  size_t len = strlen( dir );
+
+  return !len || ( !strncmp( path, dir, len ) && ( !path[len] || ( path[len] == '/' ) ) );
+}
+
+
+/* This function watches a directory, if it is not watched yet.
+ * Parameters:
+ *             dir : the directory, "" for the top
+ * Returns: 0 if the directory is watched, -1 if it cannot be.
+ */
+static int watch_one( const char *dir ) {
+  watch *w;
+  watch **grown;
+  int wd;
+
+  wd = inotify_add_watch( notify, *dir ? dir : ".", WATCH_EVENTS );
+  if( wd < 0 ) {
+    return -1;
+  }
+
+  pthread_mutex_lock( &lock );
+  if( wd >= nwds ) {
+    grown = realloc( wds, ( wd + 64 ) * sizeof( watch * ) );
+    if( !grown ) {
+      perror( "Error while allocating memory" );
+      abort();
+    }
+    memset( grown + nwds, 0, ( wd + 64 - nwds ) * sizeof( watch * ) );
+    wds = grown;
+    nwds = wd + 64;
+  }
+  if( !wds[wd] ) {                                      /* a new directory */
+    w = calloc( 1, sizeof( watch ) );
+    if( !w || !( w->node.key = strdup( dir ) ) ) {
+      perror( "Error while allocating memory" );
+      abort();
+    }
+    w->wd = wd;
+    wds[wd] = w;
+    lru_insert( &dirs, &w->node );
+  }
+  pthread_mutex_unlock( &lock );
+  return 0;
+}
+
+
+/* This function watches the directory of a path and every directory above
+ *    it up to the top, those not watched yet, so that a directory renamed
+ *    or replaced anywhere above the file is seen.  It notes how many events
+ *    had been seen before it looked, so that any later change can be
+ *    detected.
+ * Parameters:
+ *             path : the normalized path of a file
+ *             seen : set to the number of events seen so far
+ * Returns: 0 if the directories are watched, -1 if one cannot be.
+ */
+static int watch_dir( const char *path, unsigned long *seen ) {
+  const char *slash = strrchr( path, '/' );
+  int len = slash ? slash - path : 0;
+  char dir[PATH_MAX];
+  int missing = 0;
+  char c;
+  int i;
+
+  if( len >= sizeof( dir ) ) {
+    return -1;
+  }
+  memcpy( dir, path, len );
+  dir[len] = '\0';
+
+  pthread_mutex_lock( &lock );                          /* "" and every */
+  *seen = changes;                                      /* dir below it */
+  for( i = 0; i <= len; i++ ) {
+    if( ( i == 0 ) || ( i == len ) || ( dir[i] == '/' ) ) {
+      c = dir[i];
+      dir[i] = '\0';
+      missing |= !lru_find( &dirs, dir );
+      dir[i] = c;
+    }
+  }
+  pthread_mutex_unlock( &lock );
+
+  for( i = 0; missing && ( i <= len ); i++ ) {          /* top down */
+    if( ( i == 0 ) || ( i == len ) || ( dir[i] == '/' ) ) {
+      c = dir[i];
+      dir[i] = '\0';
+      if( watch_one( dir ) ) {
+        return -1;
+      }
+      dir[i] = c;
+    }
+  }
+  return 0;
+}
+
+
+/* This function stops watching a directory and every directory below it.
+ *    The lock must be held.
+ * Parameters:
+ *             dir : the directory
+ * Returns: None
+ */
+static void unwatch( const char *dir ) {
+  lru_node *n, *next;
+  watch *w;
+
+  for( n = dirs.mru; n; n = next ) {
+    next = n->next;
+    if( below( n->key, dir ) ) {
+      w = (watch *)n;
+      inotify_rm_watch( notify, w->wd );                /* fails if gone */
+      wds[w->wd] = NULL;
+      lru_remove( &dirs, n );
+      free( n->key );
+      free( w );
+    }
+  }
+}
+
+
+/* This function drops the entries of every file below a directory.  The
+ *    lock must be held.
+ * Parameters:
+ *             dir : the directory, "" for all entries
+ * Returns: None
+ */
+static void flush( const char *dir ) {
+  lru_node *n, *next;
+
+  for( n = table.mru; n; n = next ) {
+    next = n->next;
+    if( below( n->key, dir ) ) {
+      evict( (fdcache_entry *)n );
+    }
+  }
+}
+
+
+/* This function drops the entries an inotify event makes stale.  An event
+ *    on a file drops its entry.  An event on a directory, either a watched
+ *    one or a subdirectory of one, drops every entry below it, since those
+ *    paths may now name other files; if the directory went away or was
+ *    renamed, it and the directories below it are no longer watched, so
+ *    they are watched again under their new names.  If the kernel dropped
+ *    events, every entry goes.  The lock must be held.
+ * Parameters:
+ *             ev : the event
+ * Returns: None
+ */
+static void invalidate( struct inotify_event *ev ) {
+  char path[PATH_MAX];
+  fdcache_entry *e;
+  watch *w;
+
+  changes++;
+  if( ev->mask & IN_Q_OVERFLOW ) {
+    flush( "" );
+    return;
+  }
+  w = ( ev->wd >= 0 ) && ( ev->wd < nwds ) ? wds[ev->wd] : NULL;
+  if( !w ) {                                            /* nothing below an */
+    return;                                             /* unwatched dir is */
+  }                                                     /* cached */
+
+  if( !ev->len ) {                                      /* the dir itself */
+    snprintf( path, sizeof( path ), "%s", w->node.key );
+    flush( path );
+    if( ev->mask & GONE_EVENTS ) {
+      unwatch( path );
+    }
+    return;
+  }
+
+  snprintf( path, sizeof( path ), "%s%s%s", w->node.key, *w->node.key ? "/" : "",
+            ev->name );
+  if( ev->mask & IN_ISDIR ) {                           /* a subdirectory */
+    flush( path );
+    unwatch( path );
+    return;
+  }
+  e = (fdcache_entry *)lru_find( &table, path );
+  if( e ) {
+    evict( e );
+  }
+}
+
+
+/* This function is the main loop of the thread that reads inotify events.
+ */
+static void *watcher( void *arg ) {
+  char buf[4096] __attribute__( ( aligned( __alignof__( struct inotify_event ) ) ) );
+  struct inotify_event *ev;
+  char *p;
+  ssize_t n;
+
+  for( ;; ) {
+    n = read( notify, buf, sizeof( buf ) );
+    if( n <= 0 ) {
+      if( ( n < 0 ) && ( errno == EINTR ) ) {
+        continue;
+      }
+      perror( "Error while reading inotify events" );
+      break;
+    }
+    pthread_mutex_lock( &lock );
+    for( p = buf; p < buf + n; p += sizeof( struct inotify_event ) + ev->len ) {
+      ev = (struct inotify_event *)p;
+      invalidate( ev );
+    }
+    pthread_mutex_unlock( &lock );
+  }
+
+  pthread_mutex_lock( &lock );                          /* entries could go */
+  limit = 0;                                            /* stale, so stop */
+  flush( "" );                                          /* caching */
+  pthread_mutex_unlock( &lock );
+  return NULL;
+}
+
+
+extern void fdcache_init( int budget ) {
+  pthread_t thread;
+
+  if( budget <= 0 ) {
+    return;
+  }
+  notify = inotify_init1( IN_CLOEXEC );
+  if( ( notify >= 0 ) && !pthread_create( &thread, NULL, watcher, NULL ) ) {
+    limit = budget;
+  }
+}
+
+
+extern int fdcache_enabled( void ) {
+  return limit > 0;
+}
+
+
+extern fdcache_entry *fdcache_get( const char *path ) {
+  fdcache_entry *e;                                     /* entry for path */
+  fdcache_entry *dup;                                   /* entry added by */
+  unsigned long seen;                                   /* another thread */
+  int watched;
+  int fd;
+
+  pthread_mutex_lock( &lock );
+  e = (fdcache_entry *)lru_find( &table, path );
+  if( e ) {                                             /* hit */
+    e->refs++;
+    lru_touch( &table, &e->node );
+  }
+  pthread_mutex_unlock( &lock );
+  if( e ) {
+    return e;
+  }
+
+  /* watch the directory before opening the file, so no change is missed */
+  watched = ( limit > 0 ) && !watch_dir( path, &seen );
+
+  fd = open( path, O_RDONLY | O_CLOEXEC );             /* miss */
+  if( fd < 0 ) {
+    return NULL;
+  }
+  e = calloc( 1, sizeof( fdcache_entry ) );
+  if( !e || !( e->node.key = strdup( path ) ) ) {
+    perror( "Error while allocating memory" );
+    abort();
+  }
+  e->fd = fd;
+  if( fstat( fd, &e->st ) || !S_ISREG( e->st.st_mode ) ) {
+    destroy( e );
+    errno = EISDIR;                                     /* or not a file */
+    return NULL;
+  }
+  header_init( &e->header, path, &e->st );
+  e->refs = 1;
+
+  pthread_mutex_lock( &lock );
+  if( watched && ( limit > 0 ) && ( seen == changes ) ) {   /* not changed */
+    dup = (fdcache_entry *)lru_find( &table, path );    /* since, so cache */
+    if( dup ) {                                         /* lost the race */
+      evict( dup );
+    }
+    while( table.lru && ( table.count >= limit ) ) {    /* make room */
+      evict( (fdcache_entry *)table.lru );
+    }
+    lru_insert( &table, &e->node );
+    e->cached = 1;
+  }
+  pthread_mutex_unlock( &lock );
+  return e;
+}
+
+
+extern void fdcache_release( fdcache_entry *e ) {
+  int gone;
+
+  pthread_mutex_lock( &lock );
+  e->refs--;
+  gone = ( e->refs == 0 ) && !e->cached;
+  pthread_mutex_unlock( &lock );
+
+  if( gone ) {
+    destroy( e );
+  }
+}
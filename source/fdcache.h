@@ -0,0 +1,87 @@
+/*
+ * File: fdcache.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          open file cache, which keeps the files being served open along
+ *          with their status and response headers.
+ */
+
+#ifndef FDCACHE_H
+#define FDCACHE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "header.h"
+#include "lru.h"
+
+/*
+ * This module has four functions:
+ *   fdcache_init()    : initialize the cache and start watching files
+ *   fdcache_enabled() : check if files are kept open and watched
+ *   fdcache_get()     : look up a file, opening it on a miss
+ *   fdcache_release() : release an entry returned by fdcache_get()
+ *
+ * An entry holds an open descriptor of a regular file, its struct stat and
+ * its response headers, which include its size, ETag and MIME type, so a
+ * hit costs no path lookup or system call at all.  Users of an entry share
+ * its descriptor, so they must read it with pread().
+ *
+ * The cache is bounded by the number of files it keeps open, and closes the
+ * least recently used files when it is full; a file that is still in use
+ * is closed by its last user.  Entries never go stale: every directory
+ * holding a cached file, and every directory above it up to the top, is
+ * watched with inotify, and a thread drops the entry of any file that is
+ * written, renamed, deleted or has its status changed, so the next request
+ * opens the new version.  If a directory changes, e.g. it or one above it
+ * is renamed, every entry below it is dropped, and if the kernel drops
+ * events, every entry is dropped.  The module is thread safe.
+ */
+
+typedef struct fdcache_entry {
+  lru_node node;                        /* path and links, must be first */
+  int fd;                               /* the open file */
+  struct stat st;                       /* its status when it was opened */
+  file_header header;                   /* response headers of the file */
+  int refs;                             /* number of users of the entry */
+  int cached;                           /* 0 once evicted or invalidated */
+} fdcache_entry;
+
+
+/* This function initializes the cache.  It should be called once, before
+ *    any other function of this module.  If inotify is not available, the
+ *    cache is disabled.
+ * Parameters:
+ *             budget : the most files to keep open, 0 to disable the cache,
+ *                      in which case every fdcache_get() opens the file
+ * Returns: None
+ */
+extern void fdcache_init( int budget );
+
+
+/* This function checks if the cache is keeping files open, in which case
+ *    the status of a cached file is kept up to date by inotify.
+ * Parameters: None
+ * Returns: 1 if the cache is enabled, 0 otherwise.
+ */
+extern int fdcache_enabled( void );
+
+
+/* This function looks up a file, and opens it if it is not in the cache.
+ * Parameters:
+ *             path : the normalized path of the file
+ * Returns: The entry of the file, which must be passed to fdcache_release()
+ *          once the caller is done with it, or NULL with errno set if the
+ *          file cannot be opened or is not a regular file.
+ */
+extern fdcache_entry *fdcache_get( const char *path );
+
+
+/* This function releases an entry returned by fdcache_get(), closing its
+ *    file if the entry has left the cache and this was its last user.
+ * Parameters:
+ *             e : the entry
+ * Returns: None
+ */
+extern void fdcache_release( fdcache_entry *e );
+
+#endif
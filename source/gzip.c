@@ -0,0 +1,366 @@
+/*
+ * File: gzip.c
+ * Purpose: This file contains the compressed-object cache.
+ *          Please see gzip.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "gzip.h"
+
+#define PATH_MAX_GZ 1024                    /* longest path of a foo.gz */
+
+typedef struct gzip_job {
+  char *path;                               /* file to compress */
+  file_header raw;                          /* headers of the file */
+  struct gzip_job *next;
+} gzip_job;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;
+static lru_table table;                     /* entries by path and recency */
+static gzip_job *jobs = NULL;               /* files to compress, in order */
+static gzip_job *last_job = NULL;
+static long used = 0;                       /* bytes held by entries */
+static long limit = 0;                      /* capacity of the cache */
+static long largest = 0;                    /* largest file to compress */
+
+
+/* This function returns the bytes an entry counts against the limit. */
+static long footprint( gzip_entry *e ) {
+  return e->size + sizeof( gzip_entry );
+}
+
+
+/* This function frees an entry. */
+static void destroy( gzip_entry *e ) {
+  free( e->data );
+  free( e->node.key );
+  free( e );
+}
+
+
+/* This function removes an entry from the cache, and frees it if it has no
+ *    users.  Lock must be held.
+ */
+static void evict( gzip_entry *e ) {
+  lru_remove( &table, &e->node );
+  used -= footprint( e );
+  e->cached = 0;
+  if( e->refs == 0 ) {
+    destroy( e );
+  }
+}
+
+
+/* This function adds an entry to the cache, replacing any entry for the
+ *    same path and making room for it.  Lock must be held.
+ */
+static void insert( gzip_entry *e ) {
+  gzip_entry *dup = (gzip_entry *)lru_find( &table, e->node.key );
+
+  if( dup ) {
+    evict( dup );
+  }
+  while( table.lru && ( used + footprint( e ) > limit ) ) {
+    evict( (gzip_entry *)table.lru );
+  }
+  e->cached = 1;
+  lru_insert( &table, &e->node );
+  used += footprint( e );
+}
+
+
+/* This function makes an entry for the gzipped copy of a file.
+ * Parameters:
+ *             path : the path of the file
+ *             raw  : the headers of the file
+ *             data : the copy, which the entry takes, or NULL if the file
+ *                    does not shrink
+ *             size : the size of the copy
+ * Returns: The entry, or NULL if out of memory.
+ */
+static gzip_entry *make( const char *path, file_header *raw, char *data,
+                         off_t size ) {
+  gzip_entry *e = calloc( 1, sizeof( gzip_entry ) );
+
+  if( !e || !( e->node.key = strdup( path ) ) ) {
+    free( e );
+    free( data );
+    return NULL;
+  }
+  snprintf( e->source, sizeof( e->source ), "%s", raw->etag );
+  e->data = data;
+  e->size = data ? size : 0;
+  if( data ) {
+    header_variant( &e->header, raw, path, size, "gzip" );
+  }
+  return e;
+}
+
+
+/* This function loads the foo.gz file next to a file, if there is one that
+ *    is no older than the file.
+ * Parameters:
+ *             path : the path of the file
+ *             raw  : the headers of the file
+ * Returns: A new entry, or NULL if there is no usable foo.gz.
+ */
+static gzip_entry *sibling( const char *path, file_header *raw ) {
+  char gz[PATH_MAX_GZ];
+  struct stat st;
+  char *data;
+  int fd;
+
+  if( snprintf( gz, sizeof( gz ), "%s.gz", path ) >= sizeof( gz ) ) {
+    return NULL;
+  }
+  fd = open( gz, O_RDONLY | O_CLOEXEC );
+  if( fd < 0 ) {
+    return NULL;
+  }
+  if( fstat( fd, &st ) || !S_ISREG( st.st_mode ) || ( st.st_size > largest )
+      || ( st.st_mtim.tv_sec < raw->mtime ) ) {
+    close( fd );                                        /* stale or too big */
+    return NULL;
+  }
+  data = lru_load( fd, st.st_size );
+  close( fd );
+  return data ? make( path, raw, data, st.st_size ) : NULL;
+}
+
+
+/* This function gzips a buffer.
+ * Parameters:
+ *             in   : the buffer
+ *             len  : the number of bytes in the buffer
+ *             size : set to the size of the result
+ * Returns: The gzipped bytes, or NULL if they are no smaller than in.
+ */
+static char *deflate_all( char *in, off_t len, off_t *size ) {
+  z_stream z;
+  char *out;
+  uLong room;
+
+  memset( &z, 0, sizeof( z ) );
+  if( deflateInit2( &z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                    Z_DEFAULT_STRATEGY ) != Z_OK ) {    /* 16 is for gzip */
+    return NULL;
+  }
+  room = deflateBound( &z, len );
+  out = malloc( room );
+  z.next_in = (Bytef *)in;
+  z.avail_in = len;
+  z.next_out = (Bytef *)out;
+  z.avail_out = room;
+  if( !out || ( deflate( &z, Z_FINISH ) != Z_STREAM_END ) || ( z.total_out >= len ) ) {
+    free( out );
+    out = NULL;
+  }
+  *size = z.total_out;
+  deflateEnd( &z );
+  return out;
+}
+
+
+/* This function compresses one queued file.  The file is only compressed
+ *    if it is still the version the request saw.
+ * Parameters:
+ *             job : the job
+ * Returns: None
+ */
+static void compress_file( gzip_job *job ) {
+  file_header now;                                      /* file as it is */
+  struct stat st;
+  gzip_entry *e;
+  char *in = NULL;
+  char *out = NULL;
+  off_t size = 0;
+  int fd;
+
+  fd = open( job->path, O_RDONLY | O_CLOEXEC );
+  if( fd < 0 ) {
+    return;
+  }
+  if( !fstat( fd, &st ) && S_ISREG( st.st_mode ) ) {
+    header_init( &now, job->path, &st );
+    if( !strcmp( now.etag, job->raw.etag ) ) {
+      in = lru_load( fd, st.st_size );
+    }
+  }
+  close( fd );
+  if( !in ) {
+    return;                                             /* changed or gone */
+  }
+  out = deflate_all( in, st.st_size, &size );
+  free( in );
+
+  e = make( job->path, &job->raw, out, size );
+  if( e ) {
+    pthread_mutex_lock( &lock );
+    insert( e );
+    pthread_mutex_unlock( &lock );
+  }
+}
+
+
+/* This function is the compressor thread.  It compresses queued files one
+ *    at a time, oldest first.
+ */
+static void *compressor( void *arg ) {
+  gzip_job *job;
+
+  for( ;; ) {
+    pthread_mutex_lock( &lock );
+    while( !jobs ) {
+      pthread_cond_wait( &queued, &lock );
+    }
+    job = jobs;
+    jobs = job->next;
+    if( !jobs ) {
+      last_job = NULL;
+    }
+    pthread_mutex_unlock( &lock );
+
+    compress_file( job );
+    free( job->path );
+    free( job );
+  }
+  return NULL;
+}
+
+
+/* This function queues a file to be compressed.  A file is queued when its
+ *    entry without data is added, which stands for the job until the copy
+ *    replaces it, so a file is not queued twice.  Lock must be held.
+ */
+static void enqueue( const char *path, file_header *raw ) {
+  gzip_job *job = malloc( sizeof( gzip_job ) );
+
+  if( !job || !( job->path = strdup( path ) ) ) {
+    free( job );
+    return;
+  }
+  job->raw = *raw;
+  job->next = NULL;
+  if( last_job ) {
+    last_job->next = job;
+  } else {
+    jobs = job;
+  }
+  last_job = job;
+  pthread_cond_signal( &queued );
+}
+
+
+extern void gzip_init( long capacity, long max_object ) {
+  pthread_t thread;
+
+  limit = capacity;
+  largest = max_object < capacity ? max_object : capacity;
+  if( ( limit > 0 ) && pthread_create( &thread, NULL, compressor, NULL ) ) {
+    limit = 0;
+  }
+}
+
+
+extern int gzip_accepted( http_parser *p ) {
+  http_slice *s = http_header( p, "Accept-Encoding" );
+  int i = 0;
+  int start, end;
+  double q;
+
+  while( s && ( i < s->len ) ) {
+    while( ( i < s->len ) && ( s->p[i] == ' ' || s->p[i] == ',' || s->p[i] == '\t' ) ) {
+      i++;                                              /* skip separators */
+    }
+    start = i;
+    while( ( i < s->len ) && ( s->p[i] != ',' ) && ( s->p[i] != ';' )
+           && ( s->p[i] != ' ' ) ) {
+      i++;
+    }
+    end = i;
+    q = 1;
+    for( ; ( i < s->len ) && ( s->p[i] != ',' ); i++ ) {
+      if( ( s->p[i] == 'q' ) && ( i + 2 < s->len ) && ( s->p[i + 1] == '=' ) ) {
+        q = atof( s->p + i + 2 );                       /* stops at , or ; */
+      }
+    }
+    if( ( ( end - start == 4 ) && !strncasecmp( s->p + start, "gzip", 4 ) )
+        || ( ( end - start == 1 ) && ( s->p[start] == '*' ) ) ) {
+      return q > 0;
+    }
+  }
+  return 0;
+}
+
+
+extern gzip_entry *gzip_get( const char *path, file_header *raw ) {
+  gzip_entry *e;
+  gzip_entry *none;                                     /* no copy yet */
+  gzip_entry *dup;
+
+  if( limit <= 0 ) {
+    return NULL;
+  }
+
+  pthread_mutex_lock( &lock );
+  e = (gzip_entry *)lru_find( &table, path );
+  if( e && strcmp( e->source, raw->etag ) ) {           /* file changed */
+    evict( e );
+    e = NULL;
+  }
+  if( e ) {                                             /* hit, maybe on */
+    lru_touch( &table, &e->node );                      /* a file sent */
+    if( e->data ) {                                     /* as is */
+      e->refs++;
+    } else {
+      e = NULL;
+    }
+    pthread_mutex_unlock( &lock );
+    return e;
+  }
+  pthread_mutex_unlock( &lock );
+
+  e = sibling( path, raw );                             /* miss */
+  none = e ? NULL : make( path, raw, NULL, 0 );         /* or sent as is */
+  pthread_mutex_lock( &lock );
+  if( e ) {
+    e->refs = 1;
+    insert( e );
+  } else if( none ) {
+    dup = (gzip_entry *)lru_find( &table, path );
+    if( dup && !strcmp( dup->source, raw->etag ) ) {    /* another request */
+      destroy( none );                                  /* got here first */
+    } else {
+      insert( none );                                   /* until the copy is */
+      if( raw->size <= largest ) {                      /* made, if ever */
+        enqueue( path, raw );
+      }
+    }
+  }
+  pthread_mutex_unlock( &lock );
+  return e;
+}
+
+
+extern void gzip_release( gzip_entry *e ) {
+  int gone;
+
+  pthread_mutex_lock( &lock );
+  e->refs--;
+  gone = ( e->refs == 0 ) && !e->cached;
+  pthread_mutex_unlock( &lock );
+
+  if( gone ) {
+    destroy( e );
+  }
+}
@@ -0,0 +1,89 @@
+/*
+ * File: gzip.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          compressed-object cache, which holds gzipped copies of text
+ *          files for clients that accept them.
+ */
+
+#ifndef GZIP_H
+#define GZIP_H
+
+#include <sys/types.h>
+
+#include "header.h"
+#include "http.h"
+#include "lru.h"
+
+/*
+ * This module has four functions:
+ *   gzip_init()     : inititalizes the cache and starts the compressor
+ *   gzip_accepted() : check if a client accepts gzip
+ *   gzip_get()      : look up the gzipped copy of a file
+ *   gzip_release()  : release an entry returned by gzip_get()
+ *
+ * A gzipped copy comes from a foo.gz file next to foo if there is one that
+ * is at least as new as foo.  Otherwise it is made by a background thread,
+ * so the request that first misses is sent the file as it is and does not
+ * wait for the compressor.  Each copy remembers the ETag of the file it was
+ * made from, so it is dropped as soon as the file changes.  The cache is
+ * bounded by the bytes of the copies it holds, and evicts the least
+ * recently used copies when it is full.  A file that has no copy, because
+ * it does not get any smaller, is too big, or is still waiting for the
+ * compressor, is remembered by ETag too, so a request for it neither looks
+ * for foo.gz again nor queues it twice.  The module is thread safe.
+ */
+
+typedef struct gzip_entry {
+  lru_node node;                        /* path and links, must be first */
+  char source[64];                      /* ETag of the file it was made from */
+  char *data;                           /* the gzipped body, NULL if the */
+  off_t size;                           /* file is sent as it is */
+  file_header header;                   /* response headers of the copy */
+  int refs;                             /* number of users of the entry */
+  int cached;                           /* 0 once evicted */
+} gzip_entry;
+
+
+/* This function initializes the cache and starts the thread that compresses
+ *    files.  It should be called once, before any other function of this
+ *    module.
+ * Parameters:
+ *             capacity   : the maximum number of bytes of copies to keep, 0
+ *                          to never send gzipped copies
+ *             max_object : the size of the largest file to compress
+ * Returns: None
+ */
+extern void gzip_init( long capacity, long max_object );
+
+
+/* This function checks whether the Accept-Encoding: header of a request
+ *    lists gzip, and does not give it a q of 0.
+ * Parameters:
+ *             p : the parsed request
+ * Returns: Non-zero if a gzipped response may be sent.
+ */
+extern int gzip_accepted( http_parser *p );
+
+
+/* This function looks up the gzipped copy of a file.  On a miss, a foo.gz
+ *    file is loaded if there is one, or else the file is queued to be
+ *    compressed in the background.
+ * Parameters:
+ *             path : the normalized path of the file
+ *             raw  : the headers of the file as it is now
+ * Returns: A referenced entry, or NULL if there is no copy yet or the file
+ *          does not shrink.  The entry must be passed to gzip_release()
+ *          when the caller is done with it.
+ */
+extern gzip_entry *gzip_get( const char *path, file_header *raw );
+
+
+/* This function releases an entry returned by gzip_get().  The entry is
+ *    freed once it is no longer cached and has no more users.
+ * Parameters:
+ *             e : the entry
+ * Returns: None
+ */
+extern void gzip_release( gzip_entry *e );
+
+#endif
@@ -0,0 +1,249 @@
+/*
+ * File: header.c
+ * Purpose: This file contains the precomputed response headers.
+ *          Please see header.h for documentation on how to use this module.
+ */
+
+#define _GNU_SOURCE                     /* for strptime() and timegm() */
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "header.h"
+
+#define NUMBER_MAX ( ( ( (off_t)1 << 62 ) - 1 ) * 2 + 1 )   /* largest off_t */
+
+static const struct {
+  const char *ext;
+  const char *type;
+  int compressible;                     /* worth sending gzipped */
+} types[] = {
+  { "html", "text/html; charset=utf-8", 1 },
+  { "htm",  "text/html; charset=utf-8", 1 },
+  { "css",  "text/css", 1 },
+  { "js",   "application/javascript", 1 },
+  { "json", "application/json", 1 },
+  { "txt",  "text/plain; charset=utf-8", 1 },
+  { "c",    "text/plain; charset=utf-8", 1 },
+  { "h",    "text/plain; charset=utf-8", 1 },
+  { "xml",  "application/xml", 1 },
+  { "svg",  "image/svg+xml", 1 },
+  { "png",  "image/png", 0 },
+  { "jpg",  "image/jpeg", 0 },
+  { "jpeg", "image/jpeg", 0 },
+  { "gif",  "image/gif", 0 },
+  { "ico",  "image/x-icon", 0 },
+  { "pdf",  "application/pdf", 0 },
+  { NULL,   "application/octet-stream", 0 }
+};
+
+
+/* This function looks up the type of a file from its extension.
+ * Parameters:
+ *             path : the path of the file
+ * Returns: The index of the type in types, the last one if it is unknown.
+ */
+static int type_of( const char *path ) {
+  const char *dot = strrchr( path, '.' );
+  int i;
+
+  for( i = 0; types[i].ext; i++ ) {
+    if( dot && !strchr( dot, '/' ) && !strcasecmp( dot + 1, types[i].ext ) ) {
+      break;
+    }
+  }
+  return i;
+}
+
+
+/* This function builds the header lines once the validators are known.
+ * Parameters:
+ *             h        : the headers, with etag and mtime filled in
+ *             path     : the path of the file
+ *             size     : the size of the body
+ *             encoding : the Content-Encoding of the body, or NULL
+ * Returns: None
+ */
+static void build( file_header *h, const char *path, off_t size,
+                   const char *encoding ) {
+  int type = type_of( path );
+  struct tm tm;
+
+  h->size = size;
+  gmtime_r( &h->mtime, &tm );
+  strftime( h->modified, sizeof( h->modified ), "%a, %d %b %Y %H:%M:%S GMT", &tm );
+
+  h->fields = snprintf( h->ok, sizeof( h->ok ),
+                        "HTTP/1.1 200 OK\r\nContent-Length: %lld\r\n",
+                        (long long)size );
+  h->ok_len = h->fields
+              + snprintf( h->ok + h->fields, sizeof( h->ok ) - h->fields,
+                          "Content-Type: %s\r\n%s%s%s%s"
+                          "Accept-Ranges: bytes\r\nETag: %s\r\nLast-Modified: %s\r\n",
+                          types[type].type,
+                          encoding ? "Content-Encoding: " : "",
+                          encoding ? encoding : "", encoding ? "\r\n" : "",
+                          types[type].compressible ? "Vary: Accept-Encoding\r\n" : "",
+                          h->etag, h->modified );
+  h->not_modified_len = snprintf( h->not_modified, sizeof( h->not_modified ),
+                                  "HTTP/1.1 304 Not modified\r\n%s"
+                                  "ETag: %s\r\nLast-Modified: %s\r\n",
+                                  types[type].compressible ? "Vary: Accept-Encoding\r\n" : "",
+                                  h->etag, h->modified );
+}
+
+
+extern void header_init( file_header *h, const char *path, struct stat *st ) {
+  snprintf( h->etag, sizeof( h->etag ), "\"%lx-%llx-%llx\"",
+            (unsigned long)st->st_ino, (unsigned long long)st->st_size,
+            (unsigned long long)st->st_mtim.tv_sec * 1000000000ull
+            + st->st_mtim.tv_nsec );
+  h->mtime = st->st_mtim.tv_sec;
+  build( h, path, st->st_size, NULL );
+}
+
+
+extern void header_variant( file_header *h, file_header *raw, const char *path,
+                            off_t size, const char *encoding ) {
+  snprintf( h->etag, sizeof( h->etag ), "%.*s-%s\"",
+            (int)strlen( raw->etag ) - 1, raw->etag, encoding );
+  h->mtime = raw->mtime;
+  build( h, path, size, encoding );
+}
+
+
+extern int header_compressible( const char *path ) {
+  return types[type_of( path )].compressible;
+}
+
+
+/* This function checks whether an If-None-Match value lists an entity tag,
+ *    using the weak comparison, so a W/ prefix is ignored.
+ * Parameters:
+ *             s    : the header value, a list of tags or "*"
+ *             etag : the quoted tag of the file
+ * Returns: Non-zero if the tag is in the list.
+ */
+static int etag_listed( http_slice *s, const char *etag ) {
+  int n = strlen( etag );
+  int i = 0;
+  int start;
+
+  while( i < s->len ) {
+    while( ( i < s->len ) && ( s->p[i] == ' ' || s->p[i] == ',' || s->p[i] == '\t' ) ) {
+      i++;                                              /* skip separators */
+    }
+    if( ( i < s->len ) && ( s->p[i] == '*' ) ) {
+      return 1;
+    }
+    if( ( i + 1 < s->len ) && ( s->p[i] == 'W' ) && ( s->p[i + 1] == '/' ) ) {
+      i += 2;
+    }
+    start = i;
+    while( ( i < s->len ) && ( s->p[i] != ',' ) && ( s->p[i] != ' ' ) ) {
+      i++;
+    }
+    if( ( i - start == n ) && !strncmp( s->p + start, etag, n ) ) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+extern int header_not_modified( file_header *h, http_parser *p ) {
+  http_slice *inm = http_header( p, "If-None-Match" );
+  http_slice *ims = http_header( p, "If-Modified-Since" );
+  char date[64];                                        /* NUL terminated */
+  struct tm tm;
+  time_t since;
+
+  if( inm ) {
+    return etag_listed( inm, h->etag );
+  }
+  if( !ims || ( ims->len >= sizeof( date ) ) ) {
+    return 0;
+  }
+  memcpy( date, ims->p, ims->len );
+  date[ims->len] = '\0';
+  memset( &tm, 0, sizeof( tm ) );
+  if( !strptime( date, "%a, %d %b %Y %H:%M:%S GMT", &tm ) ) {
+    return 0;                                           /* not a valid date */
+  }
+  since = timegm( &tm );
+  if( since > time( NULL ) ) {
+    return 0;                                           /* a date in the */
+  }                                                     /* future is ignored */
+  return h->mtime <= since;
+}
+
+
+/* This function parses a decimal number at the start of a slice.  A number
+ *    too large for an off_t saturates at NUMBER_MAX, which is past the end
+ *    of any file, so a range starting there is not satisfiable.
+ * Parameters:
+ *             s : the slice
+ *             i : the index of the first digit, advanced past the number
+ *             n : set to the number
+ * Returns: 1 if there was a number, 0 if not.
+ */
+static int number( http_slice *s, int *i, off_t *n ) {
+  int start = *i;
+
+  for( *n = 0; ( *i < s->len ) && ( s->p[*i] >= '0' ) && ( s->p[*i] <= '9' ); ( *i )++ ) {
+    if( *n > ( NUMBER_MAX - ( s->p[*i] - '0' ) ) / 10 ) {
+      *n = NUMBER_MAX;                                  /* saturate */
+    } else {
+      *n = *n * 10 + ( s->p[*i] - '0' );
+    }
+  }
+  return *i > start;
+}
+
+
+extern int header_range( file_header *h, http_parser *p, off_t *first,
+                         off_t *last ) {
+  http_slice *range = http_header( p, "Range" );
+  http_slice *cond = http_header( p, "If-Range" );
+  int i = 6;                                            /* after bytes= */
+  off_t a, b;
+
+  if( !range || ( range->len < i ) || strncasecmp( range->p, "bytes=", i )
+      || memchr( range->p, ',', range->len ) ) {
+    return 0;                                           /* none, or several */
+  }
+  if( cond && !http_equals( cond, h->modified )         /* changed since the */
+      && ( ( cond->len != strlen( h->etag ) )           /* client's part */
+           || strncmp( cond->p, h->etag, cond->len ) ) ) {
+    return 0;
+  }
+
+  if( ( i < range->len ) && ( range->p[i] == '-' ) ) {  /* bytes=-n, the last */
+    i++;                                                /* n bytes */
+    if( !number( range, &i, &b ) || ( i != range->len ) ) {
+      return 0;
+    }
+    if( ( b == 0 ) || ( h->size == 0 ) ) {
+      return -1;
+    }
+    *first = b < h->size ? h->size - b : 0;
+    *last = h->size - 1;
+    return 1;
+  }
+
+  if( !number( range, &i, &a ) || ( i >= range->len ) || ( range->p[i++] != '-' ) ) {
+    return 0;
+  }
+  if( i == range->len ) {                               /* bytes=a- */
+    b = h->size - 1;
+  } else if( !number( range, &i, &b ) || ( i != range->len ) || ( b < a ) ) {
+    return 0;
+  }
+  if( a >= h->size ) {
+    return -1;
+  }
+  *first = a;
+  *last = b < h->size ? b : h->size - 1;
+  return 1;
+}
@@ -0,0 +1,114 @@
+/*
+ * File: header.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          response header module, which builds the headers sent with a
+ *          file once, so they can be cached along with the file.
+ */
+
+#ifndef HEADER_H
+#define HEADER_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "http.h"
+
+/*
+ * This module has five functions:
+ *   header_init()         : build the response headers of a file
+ *   header_variant()      : build the headers of an encoded copy of a file
+ *   header_compressible() : check if a file is worth compressing
+ *   header_not_modified() : check a conditional request against a file
+ *   header_range()        : parse the byte range requested of a file
+ *
+ * The headers hold the status line, Content-Length, Content-Type, ETag and
+ * Last-Modified, and leave out Connection:, which the caller appends for
+ * each response along with the blank line that ends the headers.  The
+ * lines after Content-Length are also sent with 206 responses, whose first
+ * lines differ for each range.  The ETag is made from the inode, size and
+ * modification time of the file.  A file header lives in the cache entry
+ * or transfer of its file, so it is built once for all the requests that
+ * share the file.  An encoded copy of a file, such as its gzipped variant,
+ * has headers of its own, with a Content-Encoding: and an ETag of its own.
+ */
+
+#define HEADER_MAX 256                  /* room for one response header */
+
+typedef struct file_header {
+  off_t size;                           /* size of the file */
+  char etag[64];                        /* quoted entity tag */
+  time_t mtime;                         /* modification time in seconds */
+  char modified[32];                    /* the same, as an HTTP date */
+  char ok[HEADER_MAX];                  /* header of a 200 response */
+  int ok_len;
+  int fields;                           /* offset of the lines after */
+                                        /* Content-Length in ok */
+  char not_modified[HEADER_MAX];        /* header of a 304 response */
+  int not_modified_len;
+} file_header;
+
+
+/* This function builds the response headers of a file.
+ * Parameters:
+ *             h    : the headers
+ *             path : the path of the file, which gives the Content-Type
+ *             st   : the status of the file
+ * Returns: None
+ */
+extern void header_init( file_header *h, const char *path, struct stat *st );
+
+
+/* This function builds the response headers of an encoded copy of a file.
+ *    The copy is as fresh as the file, so it has the same Last-Modified,
+ *    and its ETag is the file's with the encoding appended.
+ * Parameters:
+ *             h        : the headers of the copy
+ *             raw      : the headers of the file
+ *             path     : the path of the file, which gives the Content-Type
+ *             size     : the size of the copy
+ *             encoding : the Content-Encoding of the copy, e.g. gzip
+ * Returns: None
+ */
+extern void header_variant( file_header *h, file_header *raw, const char *path,
+                            off_t size, const char *encoding );
+
+
+/* This function checks whether a file is of a type, such as text, that
+ *    compresses well.  Responses for such files carry Vary: Accept-Encoding.
+ * Parameters:
+ *             path : the path of the file
+ * Returns: Non-zero if the file is worth compressing.
+ */
+extern int header_compressible( const char *path );
+
+
+/* This function checks whether a request is conditional and the client's
+ *    copy of the file is still current.  If-None-Match is checked first,
+ *    and If-Modified-Since only if it is absent.  A date in the future is
+ *    ignored, as RFC 7232 section 3.3 asks.
+ * Parameters:
+ *             h : the headers of the file
+ *             p : the parsed request
+ * Returns: Non-zero if the request should be answered with a 304.
+ */
+extern int header_not_modified( file_header *h, http_parser *p );
+
+
+/* This function parses the Range: header of a request for a file.  The
+ *    forms bytes=a-b, bytes=a- and bytes=-n are understood.  A request for
+ *    several ranges, a malformed header, or an If-Range: that does not name
+ *    the current file gets the whole file.
+ * Parameters:
+ *             h     : the headers of the file
+ *             p     : the parsed request
+ *             first : set to the offset of the first byte of the range
+ *             last  : set to the offset of the last byte of the range
+ * Returns: 1 if a range should be sent with a 206, -1 if the range starts
+ *          past the end of the file and deserves a 416, or 0 if the whole
+ *          file should be sent.
+ */
+extern int header_range( file_header *h, http_parser *p, off_t *first,
+                         off_t *last );
+
+#endif
@@ -0,0 +1,269 @@
+/* 
+ * File: http.c
+ * Purpose: This file contains the incremental HTTP request parser.
+ *          Please see http.h for documentation on how to use this module.
+ */
+
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "http.h"
+
+enum {                                  /* parser states */
+  S_START,                              /* skipping blank lines before request */
+  S_METHOD,
+  S_TARGET_START,
+  S_TARGET,
+  S_VERSION_START,
+  S_VERSION,
+  S_LINE_LF,                            /* CR seen, expecting LF */
+  S_HEADER_START,                       /* at the start of a header line */
+  S_NAME,
+  S_VALUE_START,
+  S_VALUE,
+  S_END_LF,                             /* CR of the blank line seen */
+  S_DONE
+};
+
+
+/* This function checks if a char may appear in a method or header name.
+ * Parameters: 
+ *             c : the char
+ * Returns: Non-zero if c is an RFC 7230 tchar.
+ */
+static int is_tchar( unsigned char c ) {
+  return isalnum( c ) || ( c && strchr( "!#$%&'*+-.^_`|~", c ) );
+}
+
+
+/* This function ends the current header line, trimming trailing spaces off
+ *    the value and keeping the header if there is room for it.
+ */
+static void end_header( http_parser *p, char *buf ) {
+  http_header_field *h;
+  int end = p->pos;
+
+  while( ( end > p->mark ) && ( ( buf[end - 1] == ' ' ) || ( buf[end - 1] == '\t' ) ) ) {
+    end--;
+  }
+  if( p->nheaders < HTTP_MAX_HEADERS ) {
+    h = &p->headers[p->nheaders++];
+    h->value.p = buf + p->mark;
+    h->value.len = end - p->mark;
+  }
+}
+
+
+extern void http_init( http_parser *p, int limit ) {
+  memset( p, 0, sizeof( http_parser ) );
+  p->state = S_START;
+  p->limit = limit;
+}
+
+
+extern int http_parse( http_parser *p, char *buf, int len ) {
+  unsigned char c;                                      /* current char */
+
+  if( p->state == S_DONE ) {
+    return HTTP_COMPLETE;
+  }
+
+  for( ; p->pos < len; p->pos++ ) {
+    if( p->pos >= p->limit ) {                          /* request too large */
+      p->status = ( p->state <= S_TARGET ) ? 414 : 431;
+      return HTTP_ERROR;
+    }
+
+    c = buf[p->pos];
+    switch( p->state ) {
+    case S_START:                                       /* robustness, allow */
+      if( ( c == '\r' ) || ( c == '\n' ) ) {            /* leading blank lines */
+        break;
+      }
+      p->mark = p->pos;
+      p->state = S_METHOD;
+      /* fall through */
+
+    case S_METHOD:
+      if( c == ' ' ) {
+        p->method.p = buf + p->mark;
+        p->method.len = p->pos - p->mark;
+        p->state = S_TARGET_START;
+      } else if( !is_tchar( c ) ) {
+        goto bad;
+      }
+      break;
+
+    case S_TARGET_START:
+      if( c == ' ' ) {
+        break;
+      }
+      p->mark = p->pos;
+      p->state = S_TARGET;
+      /* fall through */
+
+    case S_TARGET:
+      if( ( c == ' ' ) || ( c == '\r' ) || ( c == '\n' ) ) {
+        p->target.p = buf + p->mark;
+        p->target.len = p->pos - p->mark;
+        p->mark = p->pos;
+        if( c == ' ' ) {
+          p->state = S_VERSION_START;
+        } else {                                        /* no version given */
+          p->version.p = buf + p->pos;
+          p->state = ( c == '\r' ) ? S_LINE_LF : S_HEADER_START;
+        }
+      } else if( ( c < ' ' ) || ( c == 0x7f ) ) {
+        goto bad;
+      }
+      break;
+
+    case S_VERSION_START:
+      if( c == ' ' ) {
+        break;
+      }
+      p->mark = p->pos;
+      p->state = S_VERSION;
+      /* fall through */
+
+    case S_VERSION:
+      if( ( c == '\r' ) || ( c == '\n' ) ) {
+        p->version.p = buf + p->mark;
+        p->version.len = p->pos - p->mark;
+        if( ( p->version.len < 6 ) || strncmp( p->version.p, "HTTP/", 5 ) ) {
+          goto bad;
+        }
+        p->state = ( c == '\r' ) ? S_LINE_LF : S_HEADER_START;
+      } else if( ( c <= ' ' ) || ( c == 0x7f ) ) {
+        goto bad;
+      }
+      break;
+
+    case S_LINE_LF:
+      if( c != '\n' ) {
+        goto bad;
+      }
+      p->state = S_HEADER_START;
+      break;
+
+    case S_HEADER_START:
+      if( c == '\r' ) {
+        p->state = S_END_LF;
+        break;
+      } else if( c == '\n' ) {
+        goto done;
+      } else if( ( c == ' ' ) || ( c == '\t' ) ) {
+        goto bad;                                       /* obsolete folding */
+      }
+      p->mark = p->pos;
+      p->state = S_NAME;
+      /* fall through */
+
+    case S_NAME:
+      if( c == ':' ) {
+        if( p->pos == p->mark ) {
+          goto bad;
+        }
+        if( p->nheaders < HTTP_MAX_HEADERS ) {
+          p->headers[p->nheaders].name.p = buf + p->mark;
+          p->headers[p->nheaders].name.len = p->pos - p->mark;
+        }
+        p->state = S_VALUE_START;
+      } else if( !is_tchar( c ) ) {
+        goto bad;
+      }
+      break;
+
+    case S_VALUE_START:
+      if( ( c == ' ' ) || ( c == '\t' ) ) {
+        break;
+      }
+      p->mark = p->pos;
+      p->state = S_VALUE;
+      /* fall through */
+
+    case S_VALUE:
+      if( ( c == '\r' ) || ( c == '\n' ) ) {
+        end_header( p, buf );
+        p->state = ( c == '\r' ) ? S_LINE_LF : S_HEADER_START;
+      } else if( ( ( c < ' ' ) && ( c != '\t' ) ) || ( c == 0x7f ) ) {
+        goto bad;
+      }
+      break;
+
+    case S_END_LF:
+      if( c != '\n' ) {
+        goto bad;
+      }
+      goto done;
+    }
+  }
+  if( p->pos >= p->limit ) {                            /* buffer is full */
+    p->status = ( p->state <= S_TARGET ) ? 414 : 431;
+    return HTTP_ERROR;
+  }
+  return HTTP_NEED_MORE;
+
+done:
+  p->pos++;                                             /* consume last LF */
+  p->state = S_DONE;
+  return HTTP_COMPLETE;
+
+bad:
+  p->status = 400;
+  return HTTP_ERROR;
+}
+
+
+extern http_slice *http_header( http_parser *p, const char *name ) {
+  int i;
+
+  for( i = 0; i < p->nheaders; i++ ) {
+    if( http_equals( &p->headers[i].name, name ) ) {
+      return &p->headers[i].value;
+    }
+  }
+  return NULL;
+}
+
+
+extern void http_move( http_parser *p, char *from, char *to ) {
+  int i;
+
+  p->method.p = to + ( p->method.p - from );
+  p->target.p = to + ( p->target.p - from );
+  p->version.p = to + ( p->version.p - from );
+  for( i = 0; i < p->nheaders; i++ ) {
+    p->headers[i].name.p = to + ( p->headers[i].name.p - from );
+    p->headers[i].value.p = to + ( p->headers[i].value.p - from );
+  }
+}
+
+
+extern int http_equals( const http_slice *s, const char *str ) {
+  return ( strlen( str ) == s->len ) && !strncasecmp( s->p, str, s->len );
+}
+
+
+extern int http_has_token( const http_slice *s, const char *token ) {
+  int n = strlen( token );
+  int i = 0;
+  int start;
+  int end;
+
+  while( i < s->len ) {
+    while( ( i < s->len ) && ( ( s->p[i] == ' ' ) || ( s->p[i] == ',' ) || ( s->p[i] == '\t' ) ) ) {
+      i++;                                              /* skip separators */
+    }
+    start = i;
+    while( ( i < s->len ) && ( s->p[i] != ',' ) ) {
+      i++;
+    }
+    for( end = i; ( end > start ) && ( ( s->p[end - 1] == ' ' ) || ( s->p[end - 1] == '\t' ) ); end-- );
+    if( ( end - start == n ) && !strncasecmp( s->p + start, token, n ) ) {
+      return 1;
+    }
+  }
+  return 0;
+}
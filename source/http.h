@@ -0,0 +1,121 @@
+/* 
+ * File: http.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          incremental HTTP request parser.
+ */
+
+#ifndef HTTP_H
+#define HTTP_H
+
+/* 
+ * This module has four functions:
+ *   http_init()   : prepare a parser for a new request
+ *   http_parse()  : feed the parser the bytes received so far
+ *   http_header() : look up a header of a parsed request
+ *   http_move()   : point a parsed request at a copy of its buffer
+ *
+ * The parser is resumable.  The caller appends bytes to one buffer as they
+ * arrive, in chunks of any size, and calls http_parse() after each chunk.
+ * The parser remembers where it stopped, so no byte is looked at twice.
+ * Nothing is copied: the request line and the headers are returned as
+ * slices pointing into the caller's buffer, so the buffer must not move
+ * until the request is complete, and must outlive the slices unless the
+ * request is copied with http_move().  Both bare LF and CRLF line endings are
+ * accepted.
+ */
+
+#define HTTP_NEED_MORE 0                /* request is incomplete */
+#define HTTP_COMPLETE  1                /* request has been parsed */
+#define HTTP_ERROR     2                /* request is malformed or too big */
+
+#define HTTP_MAX_HEADERS 32             /* headers kept per request */
+
+typedef struct http_slice {
+  char *p;                              /* first char, in the caller's buffer */
+  int len;                              /* number of chars */
+} http_slice;
+
+typedef struct http_header_field {
+  http_slice name;
+  http_slice value;                     /* without surrounding whitespace */
+} http_header_field;
+
+typedef struct http_parser {
+  int state;                            /* where the parser stopped */
+  int pos;                              /* bytes of the buffer consumed */
+  int mark;                             /* start of the token being parsed */
+  int limit;                            /* maximum size of a request */
+  int status;                           /* status to send on HTTP_ERROR */
+  http_slice method;                    /* e.g. GET */
+  http_slice target;                    /* e.g. /foo/bar.html */
+  http_slice version;                   /* e.g. HTTP/1.1, empty if absent */
+  http_header_field headers[HTTP_MAX_HEADERS];
+  int nheaders;                         /* number of headers kept */
+} http_parser;
+
+
+/* This function prepares a parser for a new request.
+ * Parameters: 
+ *             p     : the parser
+ *             limit : the maximum number of bytes in the request line and
+ *                     headers together
+ * Returns: None
+ */
+extern void http_init( http_parser *p, int limit );
+
+
+/* This function parses as much of a request as has arrived.
+ * Parameters: 
+ *             p   : the parser
+ *             buf : the buffer holding the request from its first byte; it
+ *                   must be the same buffer on every call for one request
+ *             len : the number of bytes in buf
+ * Returns: HTTP_NEED_MORE if the request is incomplete, HTTP_COMPLETE once
+ *          the blank line ending the headers has been parsed, in which case
+ *          p->pos is the length of the request, or HTTP_ERROR if the request
+ *          is malformed or exceeds a limit, in which case p->status holds
+ *          the status code to answer with.
+ */
+extern int http_parse( http_parser *p, char *buf, int len );
+
+
+/* This function looks up a header of a complete request, ignoring case.
+ * Parameters: 
+ *             p    : the parser
+ *             name : the name of the header, e.g. "Connection"
+ * Returns: The value of the first header with that name, or NULL.
+ */
+extern http_slice *http_header( http_parser *p, const char *name );
+
+
+/* This function points the slices of a parsed request into a copy of the
+ *    buffer it was parsed from, so the buffer can be reused while the copy
+ *    is in use, e.g. for the next pipelined request.
+ * Parameters: 
+ *             p    : a copy of the parser, whose slices are moved
+ *             from : the buffer the request was parsed from
+ *             to   : the copy, holding at least the first p->pos bytes
+ * Returns: None
+ */
+extern void http_move( http_parser *p, char *from, char *to );
+
+
+/* This function checks whether a slice equals a string, ignoring case.
+ * Parameters: 
+ *             s   : the slice
+ *             str : the string
+ * Returns: Non-zero if they are equal.
+ */
+extern int http_equals( const http_slice *s, const char *str );
+
+
+/* This function checks whether a comma separated header value, such as
+ *    the value of Connection:, contains a token, ignoring case.
+ * Parameters: 
+ *             s     : the header value
+ *             token : the token, e.g. "close"
+ * Returns: Non-zero if the token is in the list.
+ */
+extern int http_has_token( const http_slice *s, const char *token );
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * File: lru.c
+ * Purpose: This file contains the LRU table shared by the caches.
+ *          Please see lru.h for documentation on how to use this module.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "lru.h"
+
+
+/* This function unlinks a node from the recency list of its table.
+ */
+static void unlink_node( lru_table *t, lru_node *n ) {
+  if( n->prev ) {
+    n->prev->next = n->next;
+  } else {
+    t->mru = n->next;
+  }
+  if( n->next ) {
+    n->next->prev = n->prev;
+  } else {
+    t->lru = n->prev;
+  }
+  n->prev = n->next = NULL;
+}
+
+
+/* This function links a node at the front of the recency list of its table.
+ */
+static void link_node( lru_table *t, lru_node *n ) {
+  n->prev = NULL;
+  n->next = t->mru;
+  if( t->mru ) {
+    t->mru->prev = n;
+  }
+  t->mru = n;
+  if( !t->lru ) {
+    t->lru = n;
+  }
+}
+
+
+extern unsigned int lru_hash( const char *path ) {
+  uint32_t h = 2166136261u;
+
+  for( ; *path; path++ ) {
+    h = ( h ^ (unsigned char)*path ) * 16777619u;
+  }
+  return h;
+}
+
+
+extern lru_node *lru_find( lru_table *t, const char *key ) {
+  lru_node *n;
+
+  for( n = t->buckets[lru_hash( key ) % LRU_BUCKETS]; n && strcmp( n->key, key );
+       n = n->hnext );
+  return n;
+}
+
+
+extern void lru_insert( lru_table *t, lru_node *n ) {
+  lru_node **b = &t->buckets[lru_hash( n->key ) % LRU_BUCKETS];
+
+  n->hnext = *b;
+  *b = n;
+  link_node( t, n );
+  t->count++;
+}
+
+
+extern void lru_remove( lru_table *t, lru_node *n ) {
+  lru_node **p;
+
+  for( p = &t->buckets[lru_hash( n->key ) % LRU_BUCKETS]; *p != n; p = &( *p )->hnext );
+  *p = n->hnext;
+  n->hnext = NULL;
+  unlink_node( t, n );
+  t->count--;
+}
+
+
+extern void lru_touch( lru_table *t, lru_node *n ) {
+  if( t->mru != n ) {
+    unlink_node( t, n );
+    link_node( t, n );
+  }
+}
+
+
+extern char *lru_load( int fd, off_t size ) {
+  char *data = malloc( size ? size : 1 );
+  off_t got = 0;
+  ssize_t n;
+
+  while( data && ( got < size ) ) {
+    n = pread( fd, data + got, size - got, got );
+    if( n <= 0 ) {                                      /* file shrank */
+      free( data );
+      return NULL;
+    }
+    got += n;
+  }
+  return data;
+}
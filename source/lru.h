@@ -0,0 +1,100 @@
+/*
+ * File: lru.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          LRU table, the hash table and recency list shared by the caches.
+ */
+
+#ifndef LRU_H
+#define LRU_H
+
+#include <sys/types.h>
+
+/*
+ * This module has six functions:
+ *   lru_hash()   : hash a path with FNV-1a
+ *   lru_find()   : look up an entry by path
+ *   lru_insert() : add an entry as the most recently used
+ *   lru_remove() : take an entry out of the table
+ *   lru_touch()  : make an entry the most recently used
+ *   lru_load()   : read a whole file into memory for an entry
+ *
+ * An entry of a cache starts with an lru_node, which holds its key and
+ * links it into a hash chain and into the list of entries from most to
+ * least recently used, so a node found in the table can be cast back to
+ * the entry it starts.  The table never allocates or frees entries; the
+ * cache decides what to evict, usually the node at lru, and keeps its own
+ * accounting.  A table is not thread safe; the caller must hold its own
+ * lock.  A table that is all zeroes, e.g. a static one, is empty.
+ */
+
+#define LRU_BUCKETS 4096                /* hash table size */
+
+typedef struct lru_node {
+  char *key;                            /* normalized path, the key */
+  struct lru_node *hnext;               /* next node in hash chain */
+  struct lru_node *prev;                /* more recently used node */
+  struct lru_node *next;                /* less recently used node */
+} lru_node;
+
+typedef struct lru_table {
+  lru_node *buckets[LRU_BUCKETS];       /* hash chains */
+  lru_node *mru;                        /* most recently used node */
+  lru_node *lru;                        /* least recently used node */
+  long count;                           /* nodes in the table */
+} lru_table;
+
+
+/* This function hashes a path with FNV-1a.
+ * Parameters:
+ *             path : the path
+ * Returns: The 32 bit hash of the path.
+ */
+extern unsigned int lru_hash( const char *path );
+
+
+/* This function looks up a node by its key.
+ * Parameters:
+ *             t   : the table
+ *             key : the key
+ * Returns: The node, or NULL if the key is not in the table.
+ */
+extern lru_node *lru_find( lru_table *t, const char *key );
+
+
+/* This function adds a node to a table as the most recently used.  Its key
+ *    must be set, and must not be in the table already.
+ * Parameters:
+ *             t : the table
+ *             n : the node
+ * Returns: None
+ */
+extern void lru_insert( lru_table *t, lru_node *n );
+
+
+/* This function takes a node out of its table.
+ * Parameters:
+ *             t : the table
+ *             n : the node, which must be in t
+ * Returns: None
+ */
+extern void lru_remove( lru_table *t, lru_node *n );
+
+
+/* This function makes a node the most recently used of its table.
+ * Parameters:
+ *             t : the table
+ *             n : the node, which must be in t
+ * Returns: None
+ */
+extern void lru_touch( lru_table *t, lru_node *n );
+
+
+/* This function reads a whole file into memory.
+ * Parameters:
+ *             fd   : the open file, which is read with pread()
+ *             size : the size of the file
+ * Returns: The body of the file, or NULL if it could not be read or shrank.
+ */
+extern char *lru_load( int fd, off_t size );
+
+#endif
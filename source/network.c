@@ -6,6 +6,8 @@
  */
 
 
+#define _GNU_SOURCE
+
 #include <stddef.h>
 #include <math.h>
 #include <stdio.h>
@@ -18,12 +20,412 @@
 #include <errno.h>
 #include <unistd.h>
 #include <sys/wait.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/resource.h>
+#include <fcntl.h>
 #include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 
 #include "network.h"
+#include "uring.h"
+
+#define CLIENT_EVENTS ( EPOLLET | EPOLLONESHOT | EPOLLRDHUP )
+
+#define URING_ENTRIES 1024              /* submission queue of a shard */
+#define RECV_BUFFERS 256                /* recv buffers provided per shard */
+#define RECV_BUFFER_SIZE 4096
+#define SEND_CHUNK 65536                /* bytes per linked read and send */
+
+#define OP_ACCEPT 1                     /* kinds of ring operations, kept */
+#define OP_RECV   2                     /* in the low bits of user_data */
+#define OP_POLL   3
+#define OP_OTHER  4                     /* buffers and cancels */
+#define OP_WAKE   5
+
+typedef struct shard {
+  int serv_sock;                        /* listening socket */
+  int epoll_fd;                         /* event set of the shard */
+  int write_fd;                         /* clients waiting for send space */
+  int wake_fd;                          /* eventfd of network_wake() */
+  int accept_pending;                   /* clients left over from last poll */
+  uring ring;                           /* event ring, for io_uring */
+  pthread_mutex_t lock;                 /* serializes submissions to ring */
+  char *buffers;                        /* recv buffers provided to ring */
+  int multishot;                        /* cleared if multishot accept fails */
+} shard;
+
+typedef struct received {
+  char *data;                           /* unread data of a completed recv */
+  int len;                              /* bytes of data */
+  int bid;                              /* provided buffer holding data */
+} received;
+
+static shard *shards = NULL;            /* listeners, one per shard */
+static int num_shards = 0;
+static int *owner = NULL;               /* shard of each client, by fd */
+static int max_fd = 0;                  /* size of owner */
+static int use_uring = 0;               /* io_uring instead of epoll */
+static unsigned *generation = NULL;     /* bumped when a client is closed */
+static received *stash = NULL;          /* data received by the ring, by fd */
+static __thread uring send_ring;        /* per thread ring for sending files */
+static __thread int send_ring_ready = 0;   /* 1 if set up, -1 if it failed */
+static __thread char *send_buffers;     /* SEND_CHUNK buffer of send_ring */
+static int use_sendfile = 1;            /* cleared if the kernel has no */
+static int use_splice = 1;              /* sendfile() or splice() */
+static __thread int splice_pipe[2] = { -1, -1 };  /* per thread pipe */
+
+/* This function accepts the next client waiting on a shard's listener.
+ * Parameters: 
+ *             sh : the shard
+ * Returns: A non-blocking file descriptor for the client, or -1 with errno
+ *          set if no client is waiting or an error occurred.
+ */
+static int accept_client( shard *sh ) {
+  struct sockaddr_in server;                            /* addr of client */
+  socklen_t len = sizeof( server );                     /* length of addr */
+  int sock;                                             /* socket for client */
+
+  /* the server socket is non-blocking, so no need to check it first */
+  sock = accept4( sh->serv_sock, (struct sockaddr *)&server, &len,
+                  SOCK_NONBLOCK | SOCK_CLOEXEC );
+
+  if( ( sock < 0 ) && ( errno != EAGAIN ) && ( errno != EWOULDBLOCK ) 
+      && ( errno != EINTR ) && ( errno != ECONNABORTED ) ) {
+    perror( "Error occurred on accept()" );             /* check for errors */
+  }
+  return sock;                                          /* return client conn.*/
+}
+
+
+/* This function tags a ring operation on a client, so its completion can
+ *    be matched to the client.  Completions carrying an older generation
+ *    of the client's fd belong to a connection that has been closed.
+ */
+static unsigned long long tag( int fd, int kind ) {
+  return ( (unsigned long long)generation[fd] << 32 ) | ( fd << 3 ) | kind;
+}
+
+
+/* This function queues a multishot accept on a shard's listener, which is
+ *    registered with the ring as fixed file 0.  The shard's lock must be
+ *    held.
+ */
+static void arm_accept( shard *sh ) {
+  struct io_uring_sqe *sqe = uring_sqe( &sh->ring );
+
+  if( sqe ) {
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = 0;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = sh->multishot ? IORING_ACCEPT_MULTISHOT : 0;
+    sqe->user_data = OP_ACCEPT;
+    uring_queue( &sh->ring );
+  }
+}
+
+
+/* This function queues a recv on a client into one of the shard's
+ *    provided buffers, or a poll if the client is watched for writing.
+ *    The shard's lock must be held.
+ */
+static void arm_client( shard *sh, int fd, int flags ) {
+  struct io_uring_sqe *sqe;
+
+  if( ( flags & NETWORK_READ ) && ( sqe = uring_sqe( &sh->ring ) ) ) {
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = RECV_BUFFER_SIZE;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = tag( fd, OP_RECV );
+    uring_queue( &sh->ring );
+  }
+  if( ( flags & NETWORK_WRITE ) && ( sqe = uring_sqe( &sh->ring ) ) ) {
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = tag( fd, OP_POLL );
+    uring_queue( &sh->ring );
+  }
+}
+
+
+/* This function queues a poll on a shard's wake eventfd.  The shard's lock
+ *    must be held.
+ */
+static void arm_wake( shard *sh ) {
+  struct io_uring_sqe *sqe = uring_sqe( &sh->ring );
+
+  if( sqe ) {
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = sh->wake_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = OP_WAKE;
+    uring_queue( &sh->ring );
+  }
+}
+
+
+/* This function hands recv buffers to a shard's ring.  The shard's lock
+ *    must be held.
+ */
+static void give_buffers( shard *sh, int bid, int count ) {
+  struct io_uring_sqe *sqe = uring_sqe( &sh->ring );
+
+  if( sqe ) {
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = count;
+    sqe->addr = (unsigned long)( sh->buffers + bid * RECV_BUFFER_SIZE );
+    sqe->len = RECV_BUFFER_SIZE;
+    sqe->off = bid;
+    sqe->buf_group = 0;
+    sqe->user_data = OP_OTHER;
+    uring_queue( &sh->ring );
+  }
+}
+
+
+/* This function waits for completions on a shard's ring and translates
+ *    them into events, like network_poll() does for epoll.
+ */
+static int poll_ring( shard *sh, int index, network_event *events, int max,
+                      int timeout ) {
+  struct io_uring_cqe *cqe;
+  unsigned long long data;
+  eventfd_t woken;                                      /* wakes, discarded */
+  int count = 0;
+  int res, fd, kind, bid;
+  unsigned flags;
+
+  if( !uring_peek( &sh->ring ) && uring_wait( &sh->ring, 1, timeout ) ) {
+    perror( "Error occurred on io_uring_enter()" );
+    abort();
+  }
+
+  pthread_mutex_lock( &sh->lock );                      /* for re-arming */
+  while( ( count < max ) && ( cqe = uring_peek( &sh->ring ) ) ) {
+    data = cqe->user_data;
+    res = cqe->res;
+    flags = cqe->flags;
+    uring_seen( &sh->ring );
+
+    kind = data & 7;
+    fd = ( data >> 3 ) & 0x1fffffff;
+    bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    if( ( kind == OP_RECV || kind == OP_POLL )
+        && ( data >> 32 ) != generation[fd] ) {         /* closed since */
+      if( flags & IORING_CQE_F_BUFFER ) {
+        give_buffers( sh, bid, 1 );
+      }
+      continue;
+    }
+
+    switch( kind ) {
+    case OP_ACCEPT:
+      if( !( flags & IORING_CQE_F_MORE ) ) {            /* no longer armed */
+        if( ( res == -EINVAL ) && sh->multishot ) {
+          sh->multishot = 0;                            /* kernel < 5.19 */
+        }
+        arm_accept( sh );
+      }
+      if( res < 0 ) {
+        if( ( res != -EINVAL ) && ( res != -EAGAIN ) && ( res != -ECONNABORTED ) ) {
+          errno = -res;
+          perror( "Error occurred on accept()" );
+        }
+      } else if( res >= max_fd ) {
+        close( res );
+      } else {
+        owner[res] = index;
+        arm_client( sh, res, NETWORK_READ );            /* watch for request */
+        events[count].fd = res;
+        events[count].flags = NETWORK_OPEN;
+        count++;
+      }
+      break;
+
+    case OP_RECV:
+      events[count].fd = fd;
+      events[count].flags = NETWORK_READ;
+      if( res > 0 ) {                                   /* kept for recv */
+        stash[fd].data = sh->buffers + bid * RECV_BUFFER_SIZE;
+        stash[fd].len = res;
+        stash[fd].bid = bid;
+      } else if( res != -ENOBUFS ) {                    /* closed or failed, */
+        events[count].flags |= NETWORK_HUP;             /* read() will tell */
+      }
+      count++;
+      break;
+
+    case OP_POLL:
+      events[count].fd = fd;
+      events[count].flags = NETWORK_WRITE;
+      if( ( res < 0 ) || ( res & ( POLLERR | POLLHUP ) ) ) {
+        events[count].flags |= NETWORK_HUP;
+      }
+      count++;
+      break;
+
+    case OP_WAKE:
+      eventfd_read( sh->wake_fd, &woken );              /* clear it */
+      arm_wake( sh );
+      events[count].fd = -1;
+      events[count].flags = NETWORK_WAKE;
+      count++;
+      break;
+
+    default:
+      if( ( res < 0 ) && ( res != -ENOENT ) && ( res != -EALREADY ) ) {
+        errno = -res;                                   /* not cancellations */
+        perror( "Error occurred on io_uring" );
+      }
+    }
+  }
+  pthread_mutex_unlock( &sh->lock );
+
+  return count;
+}
+
+
+/* This function sets up the ring and buffers a thread uses to send files.
+ * Returns: 1 if the thread can use uring_sendfile(), 0 if not.
+ */
+static int send_ring_init() {
+  if( send_ring_ready == 0 ) {
+    send_buffers = malloc( SEND_CHUNK );
+    if( send_buffers && !uring_init( &send_ring, 2 ) ) {
+      send_ring_ready = 1;
+    } else {
+      free( send_buffers );
+      send_ring_ready = -1;
+    }
+  }
+  return send_ring_ready > 0;
+}
+
+
+/* This function sends part of a file to a client with a read of a chunk
+ *    of the file linked to a send of it, so each chunk costs one system
+ *    call.  Only one pair is in flight at a time: a send the client's
+ *    buffer cuts short would otherwise let the next pair's data overtake
+ *    the rest of its chunk.  Sends never wait, and what the kernel could not
+ *    take of a chunk is offered once more with write() before giving up.
+ * Parameters: 
+ *             fd     : the client connection
+ *             file   : the file to send
+ *             offset : offset of the first byte, advanced by bytes sent
+ *             count  : the number of bytes to send
+ * Returns: The number of bytes sent, less than count at end of file or if
+ *          the send buffer filled, with errno set to EAGAIN, or -1 on error
+ *          with errno set.
+ */
+static int uring_sendfile( int fd, int file, off_t *offset, int count ) {
+  struct io_uring_sqe *sqe;
+  struct io_uring_cqe *cqe;
+  int result[2];                                        /* read, send */
+  int sent = 0;                                         /* bytes sent */
+  int size, i, n, done, m;
+
+  while( sent < count ) {
+    size = count - sent < SEND_CHUNK ? count - sent : SEND_CHUNK;
+
+    sqe = uring_sqe( &send_ring );                      /* read -> send */
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = file;
+    sqe->addr = (unsigned long)send_buffers;
+    sqe->len = size;
+    sqe->off = *offset;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = 0;
+    uring_queue( &send_ring );
+
+    sqe = uring_sqe( &send_ring );
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)send_buffers;
+    sqe->len = size;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+    sqe->flags = 0;
+    sqe->user_data = 1;
+    uring_queue( &send_ring );
+
+    for( i = 0; i < 2; i++ ) {                          /* reap both */
+      while( !( cqe = uring_peek( &send_ring ) ) ) {
+        if( uring_wait( &send_ring, 2 - i, -1 ) ) {
+          return -1;
+        }
+      }
+      result[cqe->user_data] = cqe->res;
+      uring_seen( &send_ring );
+    }
+
+    n = result[0];                                      /* bytes read */
+    if( n < 0 ) {
+      errno = -n;
+      return -1;
+    } else if( n == 0 ) {
+      errno = EIO;                                      /* file ended early */
+      break;
+    }
+    done = result[1] > 0 ? result[1] : 0;
+    if( ( result[1] < 0 ) && ( result[1] != -EAGAIN ) && ( result[1] != -ECANCELED ) ) {
+      errno = -result[1];
+      return -1;                                        /* client went away */
+    }
+    while( done < n ) {                                 /* e.g. EAGAIN */
+      m = write( fd, send_buffers + done, n - done );
+      if( m > 0 ) {
+        done += m;
+      } else if( ( m < 0 ) && ( errno == EINTR ) ) {
+        continue;
+      } else if( ( m < 0 ) && ( errno != EAGAIN ) && ( errno != EWOULDBLOCK ) ) {
+        return -1;
+      } else {
+        break;
+      }
+    }
+    *offset += done;
+    sent += done;
+    if( done < n ) {
+      errno = EAGAIN;                                   /* send buffer full, */
+      break;                                            /* the caller waits */
+    }
+    if( n < size ) {
+      errno = EIO;                                      /* file ended early */
+      break;
+    }
+  }
+  return sent;
+}
+
+
+/* This function checks if the kernel can run the io_uring backend.
+ *    Please see network.h for details.
+ */
+extern int network_use_uring() {
+  static const int ops[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND,
+                             IORING_OP_READ, IORING_OP_POLL_ADD,
+                             IORING_OP_PROVIDE_BUFFERS, IORING_OP_ASYNC_CANCEL };
+  unsigned needed = IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+  uring probe;
+  int i, ok;
+
+  if( uring_init( &probe, 8 ) ) {
+    return 0;                                           /* kernel < 5.1 */
+  }
+  ok = ( probe.features & needed ) == needed;
+  for( i = 0; ok && i < sizeof( ops ) / sizeof( ops[0] ); i++ ) {
+    ok = uring_supports( &probe, ops[i] );
+  }
+  uring_exit( &probe );
+  use_uring = ok;
+  return ok;
+}
 
-static int serv_sock = -1;
 
 /* This function checks if there are any web clients waiting to connect.
  *    If one or more clients are waiting to connect, this function returns.
@@ -34,23 +436,23 @@ static int serv_sock = -1;
  */
 extern void network_wait() {
   int n;                                                /* result var */
-  fd_set sel;                                           /* descriptor bits */
-  fd_set err;
+  struct pollfd pfd;                                    /* descriptor to wait */
   
-  if( serv_sock < 0 ) {                                 /* sanity check */
+  if( !shards ) {                                       /* sanity check */
     perror( "Error, network not initalized" );
     abort();
   }
 
-  FD_ZERO( &sel );                                      /* initialize bits */
-  FD_ZERO( &err );
-  FD_SET( serv_sock, &sel );
-  FD_SET( serv_sock, &err );
+  pfd.fd = shards[0].serv_sock;                         /* initialize request */
+  pfd.events = POLLIN;
+  pfd.revents = 0;
 
-  n = select( serv_sock + 1, &sel, NULL, &err, NULL );  /* wait for conn. */
+  do {
+    n = poll( &pfd, 1, -1 );                            /* wait for conn. */
+  } while( ( n < 0 ) && ( errno == EINTR ) );
 
-  if( ( n <= 0 ) || FD_ISSET( serv_sock, &err ) ) {     /* check for errors */
-    perror( "Error occurred while waiting" );
+  if( ( n <= 0 ) || ( pfd.revents & ( POLLERR | POLLNVAL ) ) ) {
+    perror( "Error occurred while waiting" );           /* check for errors */
     abort();
   } 
 }
@@ -66,78 +468,515 @@ extern void network_wait() {
  *          or -1 if no client is waiting.
  */
 extern int network_open() {
-  struct sockaddr_in server;                            /* addr of client */
-  int len = sizeof( server );                           /* length of addr */
-  int n;                                                /* return var */
-  int sock = -1;                                        /* socket for client */
-  fd_set sel;                                           /* descriptor bits */
-  fd_set err;
-  struct timeval tv;                                    /* time to wait */
-  
-  if( serv_sock < 0 ) {                                 /* sanity check */
+  if( !shards ) {                                       /* sanity check */
     perror( "Error, network not initalized" );
     abort();
   }
+  return accept_client( &shards[0] );
+}
 
-  FD_ZERO( &sel );                                      /* check for client */
-  FD_ZERO( &err );
-  FD_SET( serv_sock, &sel );
-  FD_SET( serv_sock, &err );
-  memset( &tv, 0, sizeof( tv ) );
-  n = select( serv_sock + 1, &sel, NULL, &err, &tv );
 
-  if( ( n < 0 ) || FD_ISSET( serv_sock, &err ) ) {      /* check for errors */
-    perror( "Error occurred on select()" );
+/* This function waits until one or more events are ready and returns them.
+ *    Please see network.h for details.
+ */
+extern int network_poll( int index, network_event *events, int max, int timeout ) {
+  shard *sh;                                            /* shard to poll */
+  struct epoll_event ready[64];                         /* ready descriptors */
+  struct epoll_event ev;                                /* client config */
+  eventfd_t woken;                                      /* wakes, discarded */
+  int count = 0;                                        /* events returned */
+  int writable = 0;                                     /* write set is ready */
+  int n;                                                /* result var */
+  int i;
+  int sock;
+
+  if( !shards || ( index < 0 ) || ( index >= num_shards ) ) {
+    perror( "Error, network not initalized" );          /* sanity check */
     abort();
-  } else if( ( n > 0 ) && FD_ISSET( serv_sock, &sel ) ) { /* client is waiting*/
-    /* get client connection */
-    sock = accept( serv_sock, (struct sockaddr *)&server, (socklen_t *)&len );
+  }
+  sh = &shards[index];
+
+  if( max > 64 ) {                                      /* one batch at most */
+    max = 64;
+  }
+
+  if( use_uring ) {
+    return poll_ring( sh, index, events, max, timeout );
+  }
 
-    if( sock < 0 ) {                                    /* check for errors */
-      perror( "Error occurred on select()" );
+  if( sh->accept_pending ) {                            /* don't lose clients */
+    timeout = 0;
+  }
+
+  n = epoll_wait( sh->epoll_fd, ready, max, timeout );  /* wait for events */
+  if( n < 0 ) {
+    if( errno == EINTR ) {
+      n = 0;
+    } else {
+      perror( "Error occurred on epoll_wait()" );
+      abort();
     }
   }
-  return sock;                                          /* return client conn.*/
+
+  for( i = 0; i < n; i++ ) {                            /* translate events */
+    if( ready[i].data.fd == sh->serv_sock ) {
+      sh->accept_pending = 1;                           /* accept below */
+      continue;
+    }
+    if( ready[i].data.fd == sh->write_fd ) {
+      writable = 1;                                     /* collect below */
+      continue;
+    }
+    if( ready[i].data.fd == sh->wake_fd ) {
+      eventfd_read( sh->wake_fd, &woken );              /* clear it */
+      events[count].fd = -1;
+      events[count++].flags = NETWORK_WAKE;
+      continue;
+    }
+    events[count].fd = ready[i].data.fd;
+    events[count].flags = 0;
+    if( ready[i].events & EPOLLIN ) {
+      events[count].flags |= NETWORK_READ;
+    }
+    if( ready[i].events & EPOLLOUT ) {
+      events[count].flags |= NETWORK_WRITE;
+    }
+    if( ready[i].events & ( EPOLLHUP | EPOLLRDHUP | EPOLLERR ) ) {
+      events[count].flags |= NETWORK_HUP;
+    }
+    count++;
+  }
+
+  n = writable && ( count < max ) ? epoll_wait( sh->write_fd, ready, max - count, 0 ) : 0;
+  for( i = 0; i < n; i++ ) {                            /* send space freed */
+    events[count].fd = ready[i].data.fd;
+    events[count].flags = NETWORK_WRITE;
+    if( ready[i].events & ( EPOLLHUP | EPOLLERR ) ) {
+      events[count].flags |= NETWORK_HUP;
+    }
+    count++;
+  }
+
+  while( sh->accept_pending && ( count < max ) ) {      /* accept in a batch */
+    sock = accept_client( sh );
+    if( sock < 0 ) {
+      if( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) {
+        sh->accept_pending = 0;                         /* until next edge */
+      } else if( ( errno == EMFILE ) || ( errno == ENFILE ) ) {
+        break;                                          /* retry next poll */
+      }
+      continue;
+    }
+
+    memset( &ev, 0, sizeof( ev ) );                     /* watch for request */
+    ev.events = EPOLLIN | CLIENT_EVENTS;
+    ev.data.fd = sock;
+    if( ( sock >= max_fd )
+        || epoll_ctl( sh->epoll_fd, EPOLL_CTL_ADD, sock, &ev ) ) {
+      perror( "Error occurred on epoll_ctl()" );
+      close( sock );
+      continue;
+    }
+
+    owner[sock] = index;
+    events[count].fd = sock;
+    events[count].flags = NETWORK_OPEN;
+    count++;
+  }
+
+  return count;
 }
 
 
-/* This function initializes the network module and creates a server socket
- *   bound to a specified port.  This function will abort the program if an
- *   error occurs.
+/* This function re-arms a client connection for more events.
+ *    Please see network.h for details.
+ */
+extern void network_watch( int fd, int flags ) {
+  struct epoll_event ev;                                /* client config */
+  shard *sh = &shards[owner[fd]];                       /* client's shard */
+
+  if( use_uring ) {                                     /* submit right away */
+    pthread_mutex_lock( &sh->lock );
+    arm_client( sh, fd, flags );
+    uring_submit( &sh->ring );
+    pthread_mutex_unlock( &sh->lock );
+    return;
+  }
+
+  memset( &ev, 0, sizeof( ev ) );
+  ev.data.fd = fd;
+  if( flags & NETWORK_READ ) {
+    ev.events = EPOLLIN | CLIENT_EVENTS;
+    if( epoll_ctl( sh->epoll_fd, EPOLL_CTL_MOD, fd, &ev ) ) {
+      perror( "Error occurred on epoll_ctl()" );
+    }
+  }
+  if( flags & NETWORK_WRITE ) {                         /* own set, so it */
+    ev.events = EPOLLOUT | EPOLLONESHOT;                /* leaves reads be */
+    if( epoll_ctl( sh->write_fd, EPOLL_CTL_MOD, fd, &ev )
+        && ( ( errno != ENOENT ) || epoll_ctl( sh->write_fd, EPOLL_CTL_ADD, fd, &ev ) ) ) {
+      perror( "Error occurred on epoll_ctl()" );
+    }
+  }
+}
+
+
+/* This function reads from a non-blocking client connection.
+ *    Please see network.h for details.
+ */
+extern int network_recv( int fd, void *buf, int len ) {
+  received *r = stash ? &stash[fd] : NULL;              /* from the ring */
+  shard *sh;
+  int n;
+
+  if( !r || !r->data ) {
+    return read( fd, buf, len );
+  }
+
+  n = len < r->len ? len : r->len;
+  memcpy( buf, r->data, n );
+  r->data += n;
+  r->len -= n;
+  if( r->len == 0 ) {                                   /* buffer is free */
+    r->data = NULL;
+    sh = &shards[owner[fd]];
+    pthread_mutex_lock( &sh->lock );
+    give_buffers( sh, r->bid, 1 );
+    pthread_mutex_unlock( &sh->lock );
+  }
+  return n;
+}
+
+
+/* This function writes several buffers to a non-blocking client.
+ *    Please see network.h for details.
+ */
+extern int network_sendv( int fd, struct iovec *iov, int cnt ) {
+  int total = 0;                                        /* bytes written */
+  int n;                                                /* result var */
+
+  while( cnt > 0 ) {
+    n = writev( fd, iov, cnt );
+    if( n >= 0 ) {
+      total += n;
+      while( ( cnt > 0 ) && ( n >= iov->iov_len ) ) {   /* skip sent buffers */
+        n -= iov->iov_len;
+        iov++;
+        cnt--;
+      }
+      if( cnt > 0 ) {                                   /* partial buffer */
+        iov->iov_base = (char *)iov->iov_base + n;
+        iov->iov_len -= n;
+      }
+    } else if( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) {
+      errno = EAGAIN;                                   /* send buffer full, */
+      break;                                            /* the caller waits */
+    } else if( errno != EINTR ) {
+      return -1;                                        /* client went away */
+    }
+  }
+  return total;
+}
+
+
+/* This function moves up to count bytes of a file to a client through a
+ *    pipe with splice(), so the data stays in the kernel.  If the client's
+ *    send buffer fills before the pipe is drained, the pipe is dropped and
+ *    the offset moved back, so the rest is read again next time.
  * Parameters: 
- *             port : the port on which the server should listen.  Should be
- *                    between 1024 and 65525
+ *             fd     : the client connection
+ *             file   : the file to send
+ *             offset : offset of the first byte, advanced by bytes sent
+ *             count  : the maximum number of bytes to send
+ * Returns: The number of bytes sent, 0 at end of file, or -1 on error with
+ *          errno set.  errno is EAGAIN if the send buffer filled, and 0
+ *          otherwise.
+ */
+static int splice_file( int fd, int file, off_t *offset, int count ) {
+  int n;                                                /* bytes in the pipe */
+  int m = 0;                                            /* result var */
+  int sent = 0;                                         /* bytes out of pipe */
+  int error;
+
+  if( ( splice_pipe[0] < 0 ) && pipe2( splice_pipe, O_CLOEXEC ) ) {
+    return -1;
+  }
+
+  errno = 0;
+  n = splice( file, offset, splice_pipe[1], NULL, count, SPLICE_F_MOVE );
+  if( n <= 0 ) {
+    return n;
+  }
+
+  while( sent < n ) {                                   /* drain the pipe */
+    m = splice( splice_pipe[0], NULL, fd, NULL, n - sent, 
+                SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+    if( m > 0 ) {
+      sent += m;
+    } else if( ( m < 0 ) && ( errno == EINTR ) ) {
+      continue;
+    } else {
+      break;
+    }
+  }
+  if( sent == n ) {
+    errno = 0;
+    return n;
+  }
+
+  error = ( m < 0 ) && ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) ? EAGAIN : EPIPE;
+  close( splice_pipe[0] );                              /* pipe holds stale */
+  close( splice_pipe[1] );                              /* data, so drop it */
+  splice_pipe[0] = splice_pipe[1] = -1;
+  *offset -= n - sent;
+  errno = error;
+  return ( sent > 0 ) || ( error == EAGAIN ) ? sent : -1;
+}
+
+
+/* This function sends part of an open file to a non-blocking client.
+ *    Please see network.h for details.
+ */
+extern int network_sendfile( int fd, int file, off_t *offset, int count ) {
+  char buffer[8192];                                    /* fallback buffer */
+  int left = count;                                     /* bytes left */
+  int can_sendfile = __atomic_load_n( &use_sendfile, __ATOMIC_RELAXED );
+  int can_splice = __atomic_load_n( &use_splice, __ATOMIC_RELAXED );
+  int n;                                                /* result var */
+
+  if( use_uring && send_ring_init() ) {
+    return uring_sendfile( fd, file, offset, count );
+  }
+
+  while( left > 0 ) {
+    if( can_sendfile ) {
+      n = sendfile( fd, file, offset, left );
+      if( ( n < 0 ) && ( ( errno == EINVAL ) || ( errno == ENOSYS ) ) ) {
+        can_sendfile = 0;                               /* not for this file, */
+        if( errno == ENOSYS ) {                         /* or not at all */
+          __atomic_store_n( &use_sendfile, 0, __ATOMIC_RELAXED );
+        }
+        continue;
+      }
+    } else if( can_splice ) {
+      n = splice_file( fd, file, offset, left );
+      if( ( n < 0 ) && ( ( errno == EINVAL ) || ( errno == ENOSYS ) ) ) {
+        can_splice = 0;                                 /* not for this file, */
+        if( errno == ENOSYS ) {                         /* or not at all */
+          __atomic_store_n( &use_splice, 0, __ATOMIC_RELAXED );
+        }
+        continue;
+      }
+      if( ( n >= 0 ) && ( errno == EAGAIN ) ) {         /* client is full */
+        left -= n;
+        break;
+      }
+    } else {
+      n = pread( file, buffer, left < sizeof( buffer ) ? left : sizeof( buffer ),
+                 *offset );
+      if( n > 0 ) {                                     /* what the client */
+        n = write( fd, buffer, n );                     /* did not take is */
+        if( n > 0 ) {                                   /* read again */
+          *offset += n;
+        }
+      }
+    }
+
+    if( n > 0 ) {
+      left -= n;
+    } else if( n == 0 ) {
+      errno = EIO;                                      /* file ended early */
+      break;
+    } else if( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) {
+      errno = EAGAIN;                                   /* send buffer full, */
+      break;                                            /* the caller waits */
+    } else if( errno != EINTR ) {
+      return -1;
+    }
+  }
+  return count - left;
+}
+
+
+/* This function stops watching a client connection and closes it.
+ *    Please see network.h for details.
+ */
+extern void network_close( int fd ) {
+  shard *sh = &shards[owner[fd]];                       /* client's shard */
+  struct io_uring_sqe *sqe;
+
+  if( use_uring ) {                                     /* drop its recv */
+    pthread_mutex_lock( &sh->lock );
+    generation[fd]++;
+    if( ( sqe = uring_sqe( &sh->ring ) ) ) {
+      sqe->opcode = IORING_OP_ASYNC_CANCEL;
+      sqe->fd = fd;
+      sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+      sqe->user_data = OP_OTHER;
+      uring_queue( &sh->ring );
+    }
+    if( stash[fd].data ) {                              /* never read */
+      stash[fd].data = NULL;
+      give_buffers( sh, stash[fd].bid, 1 );
+    }
+    uring_submit( &sh->ring );
+    pthread_mutex_unlock( &sh->lock );
+  } else {
+    epoll_ctl( sh->epoll_fd, EPOLL_CTL_DEL, fd, NULL );
+  }                                                     /* close drops it */
+  close( fd );                                          /* from write_fd */
+}
+
+
+/* This function wakes up the thread polling a shard.
+ *    Please see network.h for details.
+ */
+extern void network_wake( int index ) {
+  eventfd_write( shards[index].wake_fd, 1 );
+}
+
+
+/* This function shuts a client connection down without closing it.
+ *    Please see network.h for details.
+ */
+extern void network_abort( int fd ) {
+  shutdown( fd, SHUT_RDWR );
+}
+
+
+/* This function creates the listening socket and event set of a shard.
+ *   This function will abort the program if an error occurs.
+ * Parameters: 
+ *             sh      : the shard
+ *             port    : the port on which the server should listen
+ *             backlog : the length of the listen queue
+ *             reuse   : non-zero to share the port with other shards
  * Returns: None
  */
-extern void network_init( int port ) {
+static void listen_shard( shard *sh, int port, int backlog, int reuse ) {
   struct sockaddr_in self;                             /* socket address */
   int yes = 1;                                         /* config variable */
+  struct epoll_event ev;                               /* event config */
   
-  serv_sock = socket( PF_INET, SOCK_STREAM, 0 );       /* create socket */
-  if( serv_sock < 0 ) {
+  sh->serv_sock = socket( PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+  if( sh->serv_sock < 0 ) {                            /* create socket */
     perror( "Error while creating server socket" );
     abort();
   } 
 
                                                        /* configure socket */
-  setsockopt( serv_sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof( int ) );
-  setsockopt( serv_sock, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof( int ) );
+  setsockopt( sh->serv_sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof( int ) );
+  setsockopt( sh->serv_sock, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof( int ) );
+  if( reuse && setsockopt( sh->serv_sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof( int ) ) ) {
+    perror( "Error on setsockopt(SO_REUSEPORT)" );     /* kernel balances */
+    abort();                                           /* accepts over shards */
+  }
 
   self.sin_family = AF_INET;                           /* bind socket to port */
   self.sin_addr.s_addr = htonl( INADDR_ANY );
   self.sin_port = htons( port );
-  if( bind( serv_sock, (struct sockaddr *)&self, sizeof( self ) ) )  {
+  if( bind( sh->serv_sock, (struct sockaddr *)&self, sizeof( self ) ) )  {
     perror( "Error on bind()" );
     abort();
   }
 
-  if( listen( serv_sock, 64 ) ) {                      /* allow connections */
+  if( listen( sh->serv_sock, backlog ) ) {             /* allow connections */
     perror( "Error on listen()" );
     abort();
   }
+  sh->accept_pending = 0;
+
+  sh->wake_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+  if( sh->wake_fd < 0 ) {
+    perror( "Error on eventfd()" );
+    abort();
+  }
+
+  if( use_uring ) {                                    /* ring, not epoll */
+    sh->epoll_fd = -1;
+    sh->write_fd = -1;
+    sh->multishot = 1;
+    sh->buffers = malloc( RECV_BUFFERS * RECV_BUFFER_SIZE );
+    pthread_mutex_init( &sh->lock, NULL );
+    if( !sh->buffers || uring_init( &sh->ring, URING_ENTRIES )
+        || uring_register( &sh->ring, IORING_REGISTER_FILES, &sh->serv_sock, 1 ) ) {
+      perror( "Error on io_uring_setup()" );
+      abort();
+    }
+    give_buffers( sh, 0, RECV_BUFFERS );
+    arm_accept( sh );
+    arm_wake( sh );
+    uring_submit( &sh->ring );
+    return;
+  }
+
+  sh->epoll_fd = epoll_create1( EPOLL_CLOEXEC );       /* create event set */
+  sh->write_fd = epoll_create1( EPOLL_CLOEXEC );       /* and the set of */
+  if( ( sh->epoll_fd < 0 ) || ( sh->write_fd < 0 ) ) { /* blocked senders */
+    perror( "Error on epoll_create1()" );
+    abort();
+  }
+
+  memset( &ev, 0, sizeof( ev ) );                      /* watch for clients */
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.fd = sh->serv_sock;
+  if( epoll_ctl( sh->epoll_fd, EPOLL_CTL_ADD, sh->serv_sock, &ev ) ) {
+    perror( "Error on epoll_ctl()" );
+    abort();
+  }
+
+  ev.events = EPOLLIN;                                 /* ready when a client */
+  ev.data.fd = sh->write_fd;                           /* has send space */
+  if( epoll_ctl( sh->epoll_fd, EPOLL_CTL_ADD, sh->write_fd, &ev ) ) {
+    perror( "Error on epoll_ctl()" );
+    abort();
+  }
+
+  ev.data.fd = sh->wake_fd;                            /* and when woken */
+  if( epoll_ctl( sh->epoll_fd, EPOLL_CTL_ADD, sh->wake_fd, &ev ) ) {
+    perror( "Error on epoll_ctl()" );
+    abort();
+  }
 }
 
 
+/* This function initializes the network module with several shards.
+ *   Please see network.h for details.
+ */
+extern void network_init_shards( int port, int count, int backlog ) {
+  struct rlimit nofile;                                /* max open files */
+  int i;
 
+  getrlimit( RLIMIT_NOFILE, &nofile );                 /* map clients to */
+  max_fd = nofile.rlim_cur;                            /* their shards */
+  owner = calloc( max_fd, sizeof( int ) );
+  shards = calloc( count, sizeof( shard ) );
+  if( use_uring ) {
+    generation = calloc( max_fd, sizeof( unsigned ) );
+    stash = calloc( max_fd, sizeof( received ) );
+  }
+  if( !owner || !shards || ( use_uring && ( !generation || !stash ) ) ) {
+    perror( "Error while allocating memory" );
+    abort();
+  }
+
+  signal( SIGPIPE, SIG_IGN );                          /* a client that left */
+                                                        /* is a write error */
+  num_shards = count;
+  for( i = 0; i < count; i++ ) {
+    listen_shard( &shards[i], port, backlog, count > 1 );
+  }
+}
 
 
+/* This function initializes the network module and creates a server socket
+ *   bound to a specified port.  This function will abort the program if an
+ *   error occurs.
+ * Parameters: 
+ *             port : the port on which the server should listen.  Should be
+ *                    between 1024 and 65525
+ * Returns: None
+ */
+extern void network_init( int port ) {
+  network_init_shards( port, 1, NETWORK_BACKLOG );
+}
@@ -9,9 +9,11 @@
 #define NETWORK_H
 
 #include <stdio.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 /* 
- * This module has three functions:
+ * This module has three basic functions:
  *   network_init() : inititalizes the module
  *   network_wait() : wait until a client connects
  *   network_open() : open the next client connection
@@ -42,6 +44,37 @@
 extern void network_init( int port );
 
 
+/* This function initializes the network module with one or more shards
+ *   instead of calling network_init().  Each shard has its own server
+ *   socket bound to the port with SO_REUSEPORT, so the kernel spreads new
+ *   clients over the shards, and its own event set.  A client belongs to
+ *   the shard that accepted it.  This function will abort the program if
+ *   an error occurs.
+ * Parameters: 
+ *             port    : the port on which the server should listen
+ *             count   : the number of shards, numbered 0 to count - 1
+ *             backlog : the length of each shard's listen queue
+ * Returns: None
+ */
+extern void network_init_shards( int port, int count, int backlog );
+
+
+/* This function selects the io_uring backend, if the kernel supports it.
+ *   It must be called before network_init() or network_init_shards().
+ *   With io_uring, each shard has a ring instead of an epoll set: clients
+ *   are accepted by a multishot accept on the listener, which is registered
+ *   with the ring, and requests are received into buffers provided to the
+ *   ring, so one system call submits and reaps a whole batch of operations.
+ *   network_sendfile() sends files with linked read and send operations.
+ *   The rest of the interface is unchanged, except that clients must be
+ *   read with network_recv().
+ * Parameters: None
+ * Returns: 1 if io_uring will be used, 0 if the kernel lacks support, in
+ *          which case the module stays on epoll.
+ */
+extern int network_use_uring();
+
+
 /* This function checks if there are any web clients waiting to connect.
  *    If one or more clients are waiting to connect, this function returns.
  *    Otherwise, this function puts the program to sleep (blocks) until
@@ -63,4 +96,146 @@ extern void network_wait();
  */
 extern int network_open();
 
+
+/*
+ * In addition to the basic functions, the module has an event interface
+ * built on edge-triggered epoll:
+ *   network_poll()  : wait for and return ready events
+ *   network_watch() : re-arm a client connection for more events
+ *   network_recv()  : read from a non-blocking client
+ *   network_sendv() : write what fits of several buffers to a client
+ *   network_sendfile() : send part of a file to a non-blocking client
+ *   network_close() : stop watching and close a client connection
+ *   network_wake()  : make the poll of a shard return
+ *   network_abort() : shut a client connection down
+ *
+ * Client connections returned by network_poll() are non-blocking and are
+ * watched in one-shot mode: once an event has been reported for a client,
+ * no further events are reported for it until network_watch() is called.
+ * This lets a single thread poll while worker threads service the clients.
+ */
+
+#define NETWORK_BACKLOG 64      /* listen queue length of network_init() */
+
+#define NETWORK_OPEN   0x01     /* fd is a newly accepted client */
+#define NETWORK_READ   0x02     /* fd is readable */
+#define NETWORK_WRITE  0x04     /* fd is writable */
+#define NETWORK_HUP    0x08     /* peer closed or an error occurred on fd */
+#define NETWORK_WAKE   0x10     /* network_wake() was called, fd is -1 */
+
+typedef struct network_event {
+  int fd;                       /* client connection */
+  int flags;                    /* bitwise or of the NETWORK_* flags above */
+} network_event;
+
+
+/* This function waits until one or more events are ready and returns them.
+ *    Pending clients on the server socket are accepted in a batch until the
+ *    kernel has none left; each is reported with NETWORK_OPEN and is watched
+ *    for NETWORK_READ.  Readiness of client connections is reported with
+ *    NETWORK_READ, NETWORK_WRITE and NETWORK_HUP.  Each shard may be
+ *    polled by a different thread.
+ * Parameters: 
+ *             shard   : the shard to poll, 0 after network_init()
+ *             events  : array in which to return the events
+ *             max     : size of the events array
+ *             timeout : milliseconds to wait, 0 to return immediately or
+ *                       -1 to wait forever
+ * Returns: The number of events stored in events, 0 on timeout.
+ */
+extern int network_poll( int shard, network_event *events, int max, int timeout );
+
+
+/* This function re-arms a client connection after an event for it has been
+ *    reported by network_poll() for the connection's shard.  Reading and
+ *    writing are armed separately: watching a client for NETWORK_WRITE,
+ *    e.g. after network_sendv() found its send buffer full, leaves its
+ *    NETWORK_READ watch alone, and each is reported and disarmed on its own.
+ *    With epoll, clients waiting to write are kept in a second event set of
+ *    the shard, which is nested in the first.
+ * Parameters: 
+ *             fd    : the client connection
+ *             flags : NETWORK_READ and/or NETWORK_WRITE
+ * Returns: None
+ */
+extern void network_watch( int fd, int flags );
+
+
+/* This function reads from a non-blocking client connection, like read().
+ *    With io_uring, data the ring has already received for the client is
+ *    returned first.
+ * Parameters: 
+ *             fd  : the client connection
+ *             buf : the buffer to read into
+ *             len : the size of buf
+ * Returns: The number of bytes read, 0 if the client closed the connection,
+ *          or -1 with errno set, EAGAIN if there is nothing to read.
+ */
+extern int network_recv( int fd, void *buf, int len );
+
+
+/* This function writes several buffers to a non-blocking client connection
+ *    with as few writev() calls as possible.  It never waits: it stops as
+ *    soon as the kernel's send buffer is full, and the caller may watch the
+ *    connection for NETWORK_WRITE to go on.
+ * Parameters: 
+ *             fd  : the client connection
+ *             iov : the buffers to send; the array is modified so that it
+ *                   describes what is left
+ *             cnt : the number of buffers
+ * Returns: The total number of bytes the kernel accepted, which is less
+ *          than asked, with errno set to EAGAIN, if the send buffer filled,
+ *          or -1 if an error occurred.
+ */
+extern int network_sendv( int fd, struct iovec *iov, int cnt );
+
+
+/* This function sends part of an open file to a non-blocking client
+ *    connection without copying it through user space.  It uses sendfile(),
+ *    and falls back to splice() through a pipe and then to buffered copies
+ *    if the kernel or the file does not support it.  Like network_sendv(),
+ *    it never waits: it stops as soon as the kernel's send buffer is full.
+ * Parameters: 
+ *             fd     : the client connection
+ *             file   : the file descriptor of the file to send
+ *             offset : pointer to the offset of the first byte to send; it
+ *                      is advanced by the number of bytes sent.  The file's
+ *                      own position is not changed.
+ *             count  : the number of bytes to send
+ * Returns: The number of bytes sent, which is less than count if the file
+ *          ended early, with errno set to EIO, or if the send buffer filled,
+ *          with errno set to EAGAIN, or -1 if an error occurred.
+ */
+extern int network_sendfile( int fd, int file, off_t *offset, int count );
+
+
+/* This function stops watching a client connection and closes it.
+ * Parameters: 
+ *             fd : the client connection
+ * Returns: None
+ */
+extern void network_close( int fd );
+
+
+/* This function makes network_poll() on a shard return, with a
+ *    NETWORK_WAKE event, so another thread can hand work back to the thread
+ *    polling it, e.g. when a file it asked for has been opened.  Each shard
+ *    has an eventfd, watched like its clients, and wakes that come before
+ *    the poll are reported as one event.  It may be called from any thread.
+ * Parameters: 
+ *             shard : the shard to wake
+ * Returns: None
+ */
+extern void network_wake( int shard );
+
+
+/* This function shuts a client connection down without closing it, so a
+ *    thread that is waiting to send to it wakes up with an error, and the
+ *    descriptor cannot be reused until that thread closes it.
+ * Parameters: 
+ *             fd : the client connection
+ * Returns: None
+ */
+extern void network_abort( int fd );
+
 #endif
@@ -0,0 +1,73 @@
+/* 
+ * File: pool.c
+ * Purpose: This file contains the slab allocator.
+ *          Please see pool.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+extern void slab_init( slab *s, size_t size, int per_chunk ) {
+  s->size = size;
+  s->per_chunk = per_chunk;
+  s->free = NULL;
+  s->in_use = 0;
+  s->total = 0;
+  pthread_mutex_init( &s->lock, NULL );
+}
+
+
+/* This function allocates a new chunk of objects and puts them on the free
+ *    list.  The lock must be held.
+ */
+static void grow( slab *s ) {
+  size_t size = s->size;                                /* size of a slot */
+  char *chunk;                                          /* new objects */
+  int i;
+
+  if( size < sizeof( void * ) ) {                       /* room for the link */
+    size = sizeof( void * );
+  }
+  size = ( size + sizeof( void * ) - 1 ) & ~( sizeof( void * ) - 1 );
+  chunk = malloc( size * s->per_chunk );                /* never freed */
+
+  if( !chunk ) {                                        /* error check */
+    perror( "Error while allocating memory" );
+    abort();
+  }
+
+  for( i = s->per_chunk - 1; i >= 0; i-- ) {            /* thread free list */
+    *(void **)( chunk + i * size ) = s->free;
+    s->free = chunk + i * size;
+  }
+  s->total += s->per_chunk;
+}
+
+
+extern void *slab_alloc( slab *s ) {
+  void *obj;
+
+  pthread_mutex_lock( &s->lock );
+  if( !s->free ) {
+    grow( s );
+  }
+  obj = s->free;
+  s->free = *(void **)obj;
+  s->in_use++;
+  pthread_mutex_unlock( &s->lock );
+  return obj;
+}
+
+
+extern void slab_free( slab *s, void *obj ) {
+  if( !obj ) {
+    return;
+  }
+  pthread_mutex_lock( &s->lock );
+  *(void **)obj = s->free;
+  s->free = obj;
+  s->in_use--;
+  pthread_mutex_unlock( &s->lock );
+}
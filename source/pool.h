@@ -0,0 +1,69 @@
+/* 
+ * File: pool.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          slab allocator, which hands out fixed-size objects such as
+ *          request control blocks and connection I/O buffers.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/* 
+ * This module has three functions:
+ *   slab_init()  : inititalizes a slab of objects of one size
+ *   slab_alloc() : take an object from the slab
+ *   slab_free()  : give an object back to the slab
+ *
+ * A slab allocates memory in chunks of many objects and keeps freed objects
+ * on a free list, so they are recycled instead of being returned to malloc.
+ * Memory use therefore stays at the high-water mark of objects in use
+ * instead of growing with the number of requests served.  Slabs are thread
+ * safe.  A slab may be defined with SLAB_INITIALIZER( size, per_chunk )
+ * instead of calling slab_init().
+ */
+
+typedef struct slab {
+  size_t size;                          /* size of an object in bytes */
+  int per_chunk;                        /* objects allocated at once */
+  void *free;                           /* free list, linked through objects */
+  long in_use;                          /* objects handed out */
+  long total;                           /* objects allocated */
+  pthread_mutex_t lock;
+} slab;
+
+#define SLAB_INITIALIZER( size, per_chunk ) \
+  { ( size ), ( per_chunk ), NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER }
+
+
+/* This function initializes a slab.
+ * Parameters: 
+ *             s         : the slab
+ *             size      : the size of each object in bytes
+ *             per_chunk : the number of objects to allocate at a time
+ * Returns: None
+ */
+extern void slab_init( slab *s, size_t size, int per_chunk );
+
+
+/* This function takes an object from a slab.  The contents of the object
+ *    are undefined.  This function will abort the program if memory runs
+ *    out.
+ * Parameters: 
+ *             s : the slab
+ * Returns: A pointer to the object.
+ */
+extern void *slab_alloc( slab *s );
+
+
+/* This function gives an object back to the slab it came from.
+ * Parameters: 
+ *             s   : the slab
+ *             obj : the object, may be NULL
+ * Returns: None
+ */
+extern void slab_free( slab *s, void *obj );
+
+#endif
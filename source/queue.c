@@ -0,0 +1,116 @@
+/* 
+ * File: queue.c
+ * Purpose: This file contains the ready queues used by the schedulers.
+ *          Please see queue.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "queue.h"
+
+#define INITIAL_CAPACITY 64                 /* slots in a new queue */
+
+
+/* This function grows an array of blocks to hold twice as many blocks.
+ *    This function will abort the program if memory runs out.
+ * Parameters: 
+ *             blocks   : the array, may be NULL
+ *             capacity : pointer to the number of slots, updated on return
+ * Returns: A pointer to the new array.
+ */
+static RequestControlBlock **grow( RequestControlBlock **blocks, int *capacity ) {
+  int n = *capacity ? *capacity * 2 : INITIAL_CAPACITY;
+
+  blocks = realloc( blocks, n * sizeof( RequestControlBlock * ) );
+  if( !blocks ) {                                       /* error check */
+    perror( "Error while allocating memory" );
+    abort();
+  }
+  *capacity = n;
+  return blocks;
+}
+
+
+extern void fifo_push( fifo *q, RequestControlBlock *b ) {
+  int old = q->capacity;
+
+  if( q->size == q->capacity ) {                        /* full, so grow */
+    q->blocks = grow( q->blocks, &q->capacity );
+    if( q->head + q->size > old ) {                     /* unwrap the tail */
+      memcpy( &q->blocks[old], q->blocks,
+              ( q->head + q->size - old ) * sizeof( RequestControlBlock * ) );
+    }
+  }
+  q->blocks[( q->head + q->size ) % q->capacity] = b;
+  q->size++;
+}
+
+
+extern RequestControlBlock *fifo_pop( fifo *q ) {
+  RequestControlBlock *b = q->blocks[q->head];
+
+  q->head = ( q->head + 1 ) % q->capacity;
+  q->size--;
+  return b;
+}
+
+
+extern RequestControlBlock *fifo_at( fifo *q, int i ) {
+  return q->blocks[( q->head + i ) % q->capacity];
+}
+
+
+/* This function compares two blocks by priority, then by arrival.
+ * Parameters: 
+ *             a, b : the blocks to compare
+ * Returns: Non-zero if a should be served before b.
+ */
+static int shorter( const RequestControlBlock *a, const RequestControlBlock *b ) {
+  if( a->priority != b->priority ) {
+    return a->priority < b->priority;
+  }
+  return a->sequenceNumber < b->sequenceNumber;
+}
+
+
+extern void heap_push( heap *h, RequestControlBlock *b ) {
+  int i;
+  int parent;
+
+  if( h->size == h->capacity ) {                        /* full, so grow */
+    h->blocks = grow( h->blocks, &h->capacity );
+  }
+
+  for( i = h->size++; i > 0; i = parent ) {             /* sift up */
+    parent = ( i - 1 ) / 2;
+    if( !shorter( b, h->blocks[parent] ) ) {
+      break;
+    }
+    h->blocks[i] = h->blocks[parent];
+  }
+  h->blocks[i] = b;
+}
+
+
+extern RequestControlBlock *heap_pop( heap *h ) {
+  RequestControlBlock *top = h->blocks[0];
+  RequestControlBlock *last = h->blocks[--h->size];
+  int i = 0;
+  int child;
+
+  for( child = 1; child < h->size; i = child, child = 2 * i + 1 ) { /* sift down */
+    if( ( child + 1 < h->size ) && shorter( h->blocks[child + 1], h->blocks[child] ) ) {
+      child++;
+    }
+    if( !shorter( h->blocks[child], last ) ) {
+      break;
+    }
+    h->blocks[i] = h->blocks[child];
+  }
+  if( h->size > 0 ) {
+    h->blocks[i] = last;
+  }
+  return top;
+}
@@ -0,0 +1,83 @@
+/* 
+ * File: queue.h
+ * Purpose: This file contains the prototypes of the ready queues used by the
+ *          schedulers to order request control blocks.
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include "sws.h"
+
+/* 
+ * This module provides two growable queues of pointers to request control
+ * blocks, so blocks are never copied when they are queued or reordered:
+ *   fifo : first in, first out, used by the round robin scheduler
+ *   heap : binary min-heap ordered by priority, used by the shortest job
+ *          first and shortest remaining time schedulers.  Ties are broken by
+ *          sequenceNumber, so equal jobs are served in the order they
+ *          arrived.
+ *
+ * Both queues start empty, double their storage whenever they are full, and
+ * are not thread safe; the caller must hold its own lock.  A queue is
+ * initialized by zeroing it, e.g. fifo q = { 0 };
+ */
+
+typedef struct fifo {
+  RequestControlBlock **blocks;         /* circular array of blocks */
+  int head;                             /* index of the first block */
+  int size;                             /* number of blocks in the queue */
+  int capacity;                         /* number of slots in blocks */
+} fifo;
+
+typedef struct heap {
+  RequestControlBlock **blocks;         /* blocks[0] has the lowest priority */
+  int size;                             /* number of blocks in the heap */
+  int capacity;                         /* number of slots in blocks */
+} heap;
+
+
+/* This function appends a block to the tail of a fifo.
+ * Parameters: 
+ *             q : the fifo
+ *             b : the block to append
+ * Returns: None
+ */
+extern void fifo_push( fifo *q, RequestControlBlock *b );
+
+
+/* This function removes the block at the head of a fifo.
+ * Parameters: 
+ *             q : a non-empty fifo
+ * Returns: The block that was at the head of the fifo.
+ */
+extern RequestControlBlock *fifo_pop( fifo *q );
+
+
+/* This function returns a block in a fifo without removing it.
+ * Parameters: 
+ *             q : the fifo
+ *             i : position of the block, 0 being the head
+ * Returns: The block.
+ */
+extern RequestControlBlock *fifo_at( fifo *q, int i );
+
+
+/* This function inserts a block into a heap in O(log n) time.
+ * Parameters: 
+ *             h : the heap
+ *             b : the block to insert
+ * Returns: None
+ */
+extern void heap_push( heap *h, RequestControlBlock *b );
+
+
+/* This function removes the block with the lowest priority from a heap in
+ *    O(log n) time.
+ * Parameters: 
+ *             h : a non-empty heap
+ * Returns: The block with the lowest priority.
+ */
+extern RequestControlBlock *heap_pop( heap *h );
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ * File: ratelimit.c
+ * Purpose: This file contains the accept rate limiter.
+ *          Please see ratelimit.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "ratelimit.h"
+#include "stats.h"
+
+#define PROBES 4                        /* slots an address may use */
+
+typedef struct bucket {
+  struct in6_addr addr;                 /* address the bucket belongs to */
+  double tokens;                        /* tokens left */
+  uint64_t filled;                      /* when tokens was last updated */
+} bucket;
+
+static double rate = 0;                 /* tokens per second, 0 if off */
+static double burst;                    /* size of a bucket */
+static bucket table[RATELIMIT_BUCKETS];
+static uint32_t key;                    /* secret seed of the hash */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* This function finds the address of a peer, without its port, and hashes
+ *    it with the secret key, so clients cannot pick addresses that collide.
+ *    An IPv4 address is mapped into IPv6, so every address is hashed the
+ *    same way.
+ * Parameters:
+ *             peer : the address of the peer
+ *             addr : set to its address
+ * Returns: The first slot its bucket may be in.
+ */
+static unsigned int slot( const struct sockaddr_storage *peer, struct in6_addr *addr ) {
+  const unsigned char *p = (const unsigned char *)addr;
+  uint32_t h = 2166136261u ^ key;
+  int len;
+
+  if( peer->ss_family == AF_INET6 ) {
+    *addr = ( (const struct sockaddr_in6 *)peer )->sin6_addr;
+  } else {
+    memset( addr, 0, sizeof( *addr ) );
+    addr->s6_addr[10] = addr->s6_addr[11] = 0xff;       /* ::ffff:a.b.c.d */
+    memcpy( &addr->s6_addr[12], &( (const struct sockaddr_in *)peer )->sin_addr,
+            sizeof( struct in_addr ) );
+  }
+  for( len = sizeof( *addr ); len > 0; p++, len-- ) {
+    h = ( h ^ *p ) * 16777619u;
+  }
+  return h % RATELIMIT_BUCKETS;
+}
+
+
+/* This function adds the tokens a bucket earned since it was last filled.
+ *    The lock must be held.
+ */
+static void refill( bucket *k, uint64_t now ) {
+  k->tokens += ( now - k->filled ) / 1e9 * rate;
+  if( k->tokens > burst ) {
+    k->tokens = burst;
+  }
+  k->filled = now;
+}
+
+
+extern void ratelimit_init( double r, double b ) {
+  rate = r;
+  burst = b < 1 ? 1 : b;
+  if( getrandom( &key, sizeof( key ), 0 ) != sizeof( key ) ) {
+    key = time( NULL ) ^ (uint32_t)stats_now();
+  }
+}
+
+
+extern int ratelimit_allow( int fd ) {
+  struct sockaddr_storage peer;
+  socklen_t len = sizeof( peer );
+  struct in6_addr addr;
+  uint64_t now;
+  bucket *k = NULL;                                     /* the address's */
+  bucket *spare = NULL;                                 /* a slot to take */
+  bucket *c;
+  unsigned int first;
+  int allowed;
+  int i;
+
+  if( rate <= 0 ) {
+    return 1;
+  }
+  if( getpeername( fd, (struct sockaddr *)&peer, &len ) ) {
+    return 1;                                           /* e.g. already reset */
+  }
+
+  now = stats_now();
+  first = slot( &peer, &addr );
+  pthread_mutex_lock( &lock );
+  for( i = 0; ( i < PROBES ) && !k; i++ ) {
+    c = &table[( first + i ) % RATELIMIT_BUCKETS];
+    if( c->filled && !memcmp( &c->addr, &addr, sizeof( addr ) ) ) {
+      k = c;                                            /* its own bucket */
+    } else if( !spare && !c->filled ) {
+      spare = c;                                        /* never used */
+    } else if( !spare ) {
+      refill( c, now );                                 /* full again, so */
+      if( c->tokens >= burst ) {                        /* its owner loses */
+        spare = c;                                      /* nothing */
+      }
+    }
+  }
+  if( !k && spare ) {                                   /* a new address */
+    k = spare;
+    k->addr = addr;
+    k->tokens = burst;
+    k->filled = now;
+  } else if( !k ) {                                     /* every slot busy, */
+    k = &table[first];                                  /* so share the */
+  }                                                     /* tokens of one */
+  refill( k, now );
+  allowed = k->tokens >= 1;
+  if( allowed ) {
+    k->tokens -= 1;
+  }
+  pthread_mutex_unlock( &lock );
+  return allowed;
+}
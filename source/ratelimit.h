@@ -0,0 +1,50 @@
+/*
+ * File: ratelimit.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          accept rate limiter, which bounds how fast each client address
+ *          may open connections.
+ */
+
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+/*
+ * This module has two functions:
+ *   ratelimit_init()  : set the rate and burst of every address
+ *   ratelimit_allow() : take a token for a new connection
+ *
+ * Each source address has a token bucket that fills at rate tokens per
+ * second up to burst tokens, and a connection is allowed if it can take a
+ * token.  The buckets are a fixed table indexed by a keyed hash of the
+ * address, so memory does not grow with the number of clients and clients
+ * cannot choose addresses that collide.  A bucket remembers its address,
+ * and an address may use any of a few slots after the one it hashes to:
+ * its own bucket, an unused one, or one that has filled up again, which
+ * its owner loses nothing by giving up.  A bucket is never emptied or
+ * refilled to make room, so if every slot is busy the address shares the
+ * tokens of the first, which can only make the limit stricter.  The module
+ * is thread safe.
+ */
+
+#define RATELIMIT_BUCKETS 65536         /* slots of the bucket table */
+
+
+/* This function sets the rate of every address.  Until it is called, every
+ *    connection is allowed.
+ * Parameters:
+ *             rate  : tokens added per second
+ *             burst : most tokens a bucket holds, at least 1
+ * Returns: None
+ */
+extern void ratelimit_init( double rate, double burst );
+
+
+/* This function takes a token from the bucket of the peer of a connection.
+ * Parameters:
+ *             fd : the accepted socket
+ * Returns: Non-zero if the connection may be served, zero if its address
+ *          is over its rate.
+ */
+extern int ratelimit_allow( int fd );
+
+#endif
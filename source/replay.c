@@ -0,0 +1,231 @@
+/*
+ * File: replay.c
+ * Purpose: This file contains sws-replay, which turns a trace captured with
+ *          sws -t back into a workload.  It prints the trace as
+ *              script : a hydra test script, with each request at the time
+ *                       it arrived, to be replayed against a server by
+ *                       piping it into bench
+ *              sim    : an arrival and size trace for sws-sim, to try the
+ *                       schedulers and their settings on the same workload
+ *              text   : one line per request with all of its fields
+ *          The times are divided by the -x speed, so -x 2 replays the
+ *          trace twice as fast, and start at 0 for the first request.
+ *          Please see trace.h for the layout of a trace.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+#define USAGE "usage: sws-replay [-f script|sim|text] [-x speed] [-p port] <trace>\n"
+
+#define MISSING "__missing"             /* requested when a path is unknown */
+
+typedef struct path {
+  uint64_t hash;                        /* trace_hash() of the path */
+  char *name;                           /* the path */
+} path;
+
+static path *names;                     /* paths of the trace, by hash */
+static long nnames;
+
+
+/* This function compares two records by arrival for qsort().
+ */
+static int compare_records( const void *a, const void *b ) {
+  const trace_record *x = a;
+  const trace_record *y = b;
+
+  if( x->arrived != y->arrived ) {
+    return x->arrived < y->arrived ? -1 : 1;
+  }
+  return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+
+/* This function compares two paths by hash for qsort() and bsearch().
+ */
+static int compare_paths( const void *a, const void *b ) {
+  uint64_t x = ( (const path *)a )->hash;
+  uint64_t y = ( (const path *)b )->hash;
+
+  return ( x > y ) - ( x < y );
+}
+
+
+/* This function reads the .paths file of a trace.  A trace without one is
+ *    replayed with every request for MISSING.
+ * Parameters:
+ *             trace : the name of the trace file
+ * Returns: None
+ */
+static void read_paths( const char *trace ) {
+  char name[1024];
+  char line[1024];
+  char file[1024];
+  unsigned long long h;
+  long cap = 0;
+  FILE *in;
+
+  snprintf( name, sizeof( name ), "%s.paths", trace );
+  if( !( in = fopen( name, "r" ) ) ) {
+    fprintf( stderr, "Warning: %s is missing, paths are unknown\n", name );
+    return;
+  }
+  while( fgets( line, sizeof( line ), in ) ) {
+    if( sscanf( line, "%llx %1023s", &h, file ) < 2 ) {
+      continue;
+    }
+    if( nnames == cap ) {
+      cap = cap ? cap * 2 : 256;
+      names = realloc( names, cap * sizeof( path ) );
+      if( !names ) {
+        perror( "Error while allocating memory" );
+        abort();
+      }
+    }
+    names[nnames].hash = h;
+    names[nnames++].name = strdup( file );
+  }
+  fclose( in );
+  qsort( names, nnames, sizeof( path ), compare_paths );
+}
+
+
+/* This function looks up the path of a record.
+ * Parameters:
+ *             h : the hash of the path
+ * Returns: The path, or MISSING if it is not known.
+ */
+static const char *lookup( uint64_t h ) {
+  path key = { h, NULL };
+  path *p = h ? bsearch( &key, names, nnames, sizeof( path ), compare_paths ) : NULL;
+
+  return p ? p->name : MISSING;
+}
+
+
+/* This function maps a trace and copies out its complete records.  This
+ *    function will exit the program if the file is not a trace.
+ * Parameters:
+ *             trace  : the name of the trace file
+ *             header : set to the header of the trace
+ *             n      : set to the number of records
+ * Returns: The records, sorted by arrival.
+ */
+static trace_record *read_trace( const char *trace, trace_file *header, long *n ) {
+  struct stat st;
+  trace_file *file;
+  trace_record *ring;
+  trace_record *records;
+  uint64_t first;
+  uint64_t i;
+  int fd = open( trace, O_RDONLY );
+
+  if( ( fd < 0 ) || fstat( fd, &st ) ) {
+    perror( "Error while opening the trace" );
+    exit( 1 );
+  }
+  file = st.st_size >= sizeof( trace_file )
+         ? mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 ) : MAP_FAILED;
+  if( ( file == MAP_FAILED ) || memcmp( file->magic, TRACE_MAGIC, sizeof( file->magic ) )
+      || ( file->version != TRACE_VERSION ) || ( file->record_size != sizeof( trace_record ) )
+      || ( st.st_size < sizeof( trace_file ) + file->capacity * sizeof( trace_record ) ) ) {
+    fprintf( stderr, "Error: %s is not a trace of this version of sws\n", trace );
+    exit( 1 );
+  }
+  close( fd );
+
+  *header = *file;
+  ring = (trace_record *)( file + 1 );
+  first = header->head > header->capacity ? header->head - header->capacity : 0;
+  records = malloc( ( header->head - first + 1 ) * sizeof( trace_record ) );
+  if( !records ) {
+    perror( "Error while allocating memory" );
+    abort();
+  }
+  for( *n = 0, i = first; i < header->head; i++ ) {
+    if( ring[i % header->capacity].seq == i + 1 ) {    /* skip torn records */
+      records[( *n )++] = ring[i % header->capacity];
+    }
+  }
+  munmap( file, st.st_size );
+  qsort( records, *n, sizeof( trace_record ), compare_records );
+  return records;
+}
+
+
+int main( int argc, char **argv ) {
+  const char *format = "script";                        /* what to print */
+  double speed = 1.0;                                   /* -x */
+  int port = 38080;                                     /* for the script */
+  trace_file header;
+  trace_record *records;
+  trace_record *r;
+  double at;                                            /* seconds from start */
+  long n;
+  long i;
+  int opt;
+
+  while( ( opt = getopt( argc, argv, "f:x:p:" ) ) != -1 ) {
+    switch( opt ) {
+    case 'f':
+      format = optarg;
+      break;
+    case 'x':
+      if( ( sscanf( optarg, "%lf", &speed ) < 1 ) || ( speed <= 0 ) ) {
+        fprintf( stderr, "Error: speed must be a positive number\n" );
+        return 1;
+      }
+      break;
+    case 'p':
+      if( sscanf( optarg, "%d", &port ) < 1 ) {
+        fprintf( stderr, "Error: port must be a number\n" );
+        return 1;
+      }
+      break;
+    default:
+      fprintf( stderr, USAGE );
+      return 1;
+    }
+  }
+  if( ( optind != argc - 1 ) || ( strcmp( format, "script" ) && strcmp( format, "sim" )
+                                   && strcmp( format, "text" ) ) ) {
+    fprintf( stderr, USAGE );
+    return 1;
+  }
+
+  records = read_trace( argv[optind], &header, &n );
+  read_paths( argv[optind] );
+  if( !strcmp( format, "script" ) ) {
+    printf( "%d\n", port );
+  } else if( !strcmp( format, "sim" ) ) {
+    printf( "# %ld requests traced with %.16s at %.1fx\n", n, header.scheduler, speed );
+  } else {
+    printf( "# %ld of %llu requests traced with %.16s\n", n,
+            (unsigned long long)header.head, header.scheduler );
+    printf( "# arrival_s status size sent level first_byte_ms completed_ms path\n" );
+  }
+
+  for( i = 0; i < n; i++ ) {
+    r = &records[i];
+    at = ( r->arrived - records[0].arrived ) / 1e9 / speed;
+    if( !strcmp( format, "script" ) ) {
+      printf( "%.6f 0.0 %s\n", at, lookup( r->path ) );
+    } else if( !strcmp( format, "sim" ) ) {
+      printf( "%.6f %lld\n", at, (long long)r->size );
+    } else {
+      printf( "%.6f %d %lld %lld %d %.3f %.3f %s\n", at, r->status, (long long)r->size,
+              (long long)r->sent, r->level,
+              r->first_byte ? ( r->first_byte - r->arrived ) / 1e6 : 0,
+              ( r->completed - r->arrived ) / 1e6, lookup( r->path ) );
+    }
+  }
+  return 0;
+}
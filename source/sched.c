@@ -0,0 +1,222 @@
+/*
+ * File: sched.c
+ * Purpose: This file contains the scheduling policies.
+ *          Please see sched.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "sched.h"
+
+static int default_level_quantum[] = { 8192, 65536, 0 };
+
+int sched_quantum = 8192;
+int sched_levels = 3;
+int *sched_level_quantum = default_level_quantum;
+long sched_aging = 1 << 16;
+
+
+/* This function does nothing, for events a policy does not care about. */
+static void ignore( sched_queue *q, RequestControlBlock *b ) {
+}
+
+
+/* This function does nothing, for policies with nothing to set up. */
+static void init_none( sched_queue *q ) {
+}
+
+
+/* Round robin: one fifo, and a preempted request goes to the back. */
+
+static void rr_enqueue( sched_queue *q, RequestControlBlock *b ) {
+  b->quantum = sched_quantum;
+  fifo_push( &q->fifo, b );
+}
+
+
+static RequestControlBlock *rr_next( sched_queue *q ) {
+  return fifo_pop( &q->fifo );
+}
+
+
+static void rr_expired( sched_queue *q, RequestControlBlock *b ) {
+  fifo_push( &q->fifo, b );
+}
+
+
+/* Shortest job first: a heap by size, and a request runs to completion. */
+
+static void sjf_enqueue( sched_queue *q, RequestControlBlock *b ) {
+  b->quantum = b->bytesRemaining < INT_MAX ? b->bytesRemaining : INT_MAX;
+  b->priority = b->bytesRemaining;
+  heap_push( &q->heap, b );
+}
+
+
+static RequestControlBlock *sjf_next( sched_queue *q ) {
+  return heap_pop( &q->heap );
+}
+
+
+static void sjf_expired( sched_queue *q, RequestControlBlock *b ) {
+  b->priority = b->bytesRemaining;                      /* a turn over 2 GB */
+  heap_push( &q->heap, b );
+}
+
+
+/* Multilevel feedback queue: higher levels always run first, and a request
+ * that uses up its quantum drops one level.
+ */
+
+static void mlfb_init( sched_queue *q ) {
+  q->levels = calloc( sched_levels, sizeof( fifo ) );
+  if( !q->levels ) {
+    perror( "Error while allocating memory" );
+    abort();
+  }
+}
+
+
+static void mlfb_enqueue( sched_queue *q, RequestControlBlock *b ) {
+  b->level = 0;                                         /* new requests start */
+  b->quantum = sched_level_quantum[0];                  /* at the top */
+  fifo_push( &q->levels[0], b );
+}
+
+
+static RequestControlBlock *mlfb_next( sched_queue *q ) {
+  int level;
+
+  for( level = 0; q->levels[level].size == 0; level++ );
+  return fifo_pop( &q->levels[level] );
+}
+
+
+static void mlfb_expired( sched_queue *q, RequestControlBlock *b ) {
+  if( b->level < sched_levels - 1 ) {
+    b->level++;
+    b->quantum = sched_level_quantum[b->level];
+  }
+  fifo_push( &q->levels[b->level], b );
+}
+
+
+static void mlfb_resume( sched_queue *q, RequestControlBlock *b ) {
+  fifo_push( &q->levels[b->level], b );                 /* not demoted */
+}
+
+
+/* Shortest remaining processing time with aging: a heap by bytes left less
+ * the credit for time waited.  The credit of two requests grows at the same
+ * rate, so only the time each arrived matters and the order of the heap
+ * holds until a request is served.
+ */
+
+static void srpt_push( sched_queue *q, RequestControlBlock *b ) {
+  b->priority = b->bytesRemaining + (int64_t)( (double)sched_aging * b->arrived / 1e9 );
+  heap_push( &q->heap, b );
+}
+
+
+static void srpt_enqueue( sched_queue *q, RequestControlBlock *b ) {
+  b->quantum = sched_quantum;
+  srpt_push( q, b );
+}
+
+
+static const scheduler policies[] = {
+  { "RR", "Round Robin", init_none, rr_enqueue, rr_next, rr_expired, rr_expired,
+    ignore },
+  { "SJF", "Shortest Job First", init_none, sjf_enqueue, sjf_next, sjf_expired,
+    sjf_expired, ignore },
+  { "MLFB", "Multilevel Feedback Queue", mlfb_init, mlfb_enqueue, mlfb_next,
+    mlfb_expired, mlfb_resume, ignore },
+  { "SRPT", "Shortest Remaining Processing Time", init_none, srpt_enqueue,
+    sjf_next, srpt_push, srpt_push, ignore },
+  { NULL }
+};
+
+
+extern const scheduler *sched_find( const char *name ) {
+  int i;
+
+  for( i = 0; policies[i].name; i++ ) {
+    if( !strcmp( policies[i].name, name ) ) {
+      return &policies[i];
+    }
+  }
+  return NULL;
+}
+
+
+extern int sched_parse_levels( char *list ) {
+  char *brk;                                            /* state of strtok */
+  char *tok;                                            /* one quantum */
+  int *quanta = calloc( strlen( list ) / 2 + 1, sizeof( int ) );
+  int n = 0;
+
+  for( tok = strtok_r( list, ",", &brk ); quanta && tok; tok = strtok_r( NULL, ",", &brk ) ) {
+    if( ( sscanf( tok, "%d", &quanta[n] ) < 1 ) || ( quanta[n] < 0 ) ) {
+      free( quanta );
+      return -1;
+    }
+    n++;
+  }
+  if( n == 0 ) {
+    free( quanta );
+    return -1;
+  }
+  sched_levels = n;
+  sched_level_quantum = quanta;
+  return 0;
+}
+
+
+extern void sched_init( sched_queue *q, const scheduler *policy ) {
+  memset( q, 0, sizeof( sched_queue ) );
+  q->policy = policy;
+  q->bytes = calloc( sched_levels, sizeof( int64_t ) );
+  if( !q->bytes ) {
+    perror( "Error while allocating memory" );
+    abort();
+  }
+  policy->init( q );
+}
+
+
+extern void sched_enqueue( sched_queue *q, RequestControlBlock *b ) {
+  q->policy->enqueue( q, b );
+  q->bytes[b->level] += b->bytesRemaining;
+  q->size++;
+}
+
+
+extern RequestControlBlock *sched_next( sched_queue *q ) {
+  RequestControlBlock *b = q->policy->next( q );
+
+  q->bytes[b->level] -= b->bytesRemaining;
+  q->size--;
+  return b;
+}
+
+
+extern void sched_expired( sched_queue *q, RequestControlBlock *b ) {
+  q->policy->expired( q, b );
+  q->bytes[b->level] += b->bytesRemaining;
+  q->size++;
+}
+
+
+extern void sched_resume( sched_queue *q, RequestControlBlock *b ) {
+  q->policy->resume( q, b );
+  q->bytes[b->level] += b->bytesRemaining;
+  q->size++;
+}
+
+
+extern void sched_complete( sched_queue *q, RequestControlBlock *b ) {
+  q->policy->complete( q, b );
+}
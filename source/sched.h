@@ -0,0 +1,159 @@
+/*
+ * File: sched.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          scheduler module, which holds the scheduling policies of the
+ *          web server behind one interface.
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "sws.h"
+#include "queue.h"
+
+/*
+ * This module has eight functions:
+ *   sched_find()         : look up a policy by name
+ *   sched_parse_levels() : set the MLFB levels from a list of quanta
+ *   sched_init()         : initialize a ready queue for a policy
+ *   sched_enqueue()      : add a new request to a ready queue
+ *   sched_next()         : take the request to serve next
+ *   sched_expired()      : put back a request that used up its quantum
+ *   sched_resume()       : put back a request whose client was too slow
+ *   sched_complete()     : tell the policy a request is done
+ *
+ * A policy is a table of functions, one per event above, so adding a
+ * policy means writing those functions and listing the table in
+ * policies[] in sched.c.  The policy decides each request's quantum, the
+ * number of bytes it may send before it goes back to the ready queue.  The
+ * policies are:
+ *   RR   : round robin, sched_quantum bytes per turn
+ *   SJF  : shortest job first, each request runs to completion
+ *   MLFB : multilevel feedback queue, sched_levels levels with
+ *          sched_level_quantum[i] bytes per turn at level i; a request
+ *          that uses up its quantum drops one level
+ *   SRPT : shortest remaining processing time, sched_quantum bytes per
+ *          turn, after which the shortest request runs next.  A request
+ *          counts as sched_aging bytes shorter for each second it has been
+ *          waiting since it arrived, so large requests are not starved.
+ *          The more credit, the sooner SRPT turns into FIFO: at 1 MB/s a
+ *          5 MB file that waited 5 s goes ahead of any new request.  The
+ *          default of 64 KB/s keeps the order of SRPT under bursts, and
+ *          a file still goes ahead of any new request once it has waited
+ *          size / 64 KB seconds; 0 is pure SRPT.
+ *
+ * Every queue also counts the bytes its requests still have to send, by
+ * level, so the server can bound how much work is queued.  Policies
+ * without levels keep every request at level 0.
+ *
+ * The module knows nothing of sockets or files, so it is shared by the web
+ * server and by the simulator sws-sim.  Ready queues are not thread safe;
+ * the caller must hold its own lock.
+ */
+
+typedef struct sched_queue {
+  const struct scheduler *policy;       /* policy of the queue */
+  int size;                             /* number of requests queued */
+  int64_t *bytes;                       /* bytes queued at each level, */
+                                        /* sched_levels of them */
+  fifo fifo;                            /* ready queue of RR */
+  heap heap;                            /* ready queue of SJF and SRPT */
+  fifo *levels;                         /* ready queues of MLFB */
+} sched_queue;
+
+typedef struct scheduler {
+  const char *name;                     /* name on the command line */
+  const char *title;                    /* name to print */
+  void (*init)( sched_queue *q );
+  void (*enqueue)( sched_queue *q, RequestControlBlock *b );
+  RequestControlBlock *(*next)( sched_queue *q );
+  void (*expired)( sched_queue *q, RequestControlBlock *b );
+  void (*resume)( sched_queue *q, RequestControlBlock *b );
+  void (*complete)( sched_queue *q, RequestControlBlock *b );
+} scheduler;
+
+extern int sched_quantum;               /* bytes per turn of RR and SRPT */
+extern int sched_levels;                /* number of MLFB levels */
+extern int *sched_level_quantum;        /* bytes per turn at each level, */
+                                        /* 0 for no limit */
+extern long sched_aging;                /* SRPT bytes of credit per second */
+
+
+/* This function looks up a policy.
+ * Parameters:
+ *             name : the name of the policy, e.g. "SJF"
+ * Returns: The policy, or NULL if there is none by that name.
+ */
+extern const scheduler *sched_find( const char *name );
+
+
+/* This function sets sched_levels and sched_level_quantum from the MLFB
+ *    option, a comma separated list with the quantum of each level from
+ *    the highest priority down, 0 meaning run to completion.
+ * Parameters:
+ *             list : the list, e.g. "8192,65536,0"; it is modified
+ * Returns: 0 on success, -1 if the list is malformed.
+ */
+extern int sched_parse_levels( char *list );
+
+
+/* This function initializes an empty ready queue.  The policy's settings,
+ *    such as sched_levels, must not change after this call.
+ * Parameters:
+ *             q      : the ready queue
+ *             policy : the policy of the queue
+ * Returns: None
+ */
+extern void sched_init( sched_queue *q, const scheduler *policy );
+
+
+/* This function adds a newly parsed request to a ready queue, and sets its
+ *    quantum.
+ * Parameters:
+ *             q : the ready queue
+ *             b : the request
+ * Returns: None
+ */
+extern void sched_enqueue( sched_queue *q, RequestControlBlock *b );
+
+
+/* This function removes the request to serve next from a ready queue.
+ * Parameters:
+ *             q : a non-empty ready queue
+ * Returns: The request.
+ */
+extern RequestControlBlock *sched_next( sched_queue *q );
+
+
+/* This function puts back a request that has been served for a turn and
+ *    still has bytes to send.
+ * Parameters:
+ *             q : the ready queue
+ *             b : the request
+ * Returns: None
+ */
+extern void sched_expired( sched_queue *q, RequestControlBlock *b );
+
+
+/* This function puts back a request that was taken out of the ready queue
+ *    part way through its quantum, because its client's send buffer was
+ *    full, once the client has made room.  The request keeps its level and
+ *    quantum, and is only charged for the bytes the client took, so a slow
+ *    client is not demoted for bytes it never received.
+ * Parameters:
+ *             q : the ready queue
+ *             b : the request
+ * Returns: None
+ */
+extern void sched_resume( sched_queue *q, RequestControlBlock *b );
+
+
+/* This function tells the policy that a request has sent its last byte.
+ * Parameters:
+ *             q : the ready queue the request came from
+ *             b : the request
+ * Returns: None
+ */
+extern void sched_complete( sched_queue *q, RequestControlBlock *b );
+
+#endif
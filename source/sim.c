@@ -0,0 +1,257 @@
+/*
+ * File: sim.c
+ * Purpose: This file contains sws-sim, an offline simulator of the sws
+ *          schedulers.  It runs a policy from sched.c against a trace of
+ *          request arrivals and sizes, over one link of a given bandwidth,
+ *          with no sockets or files, and reports the response times.
+ *
+ *          The trace has one request per line, the arrival time in seconds
+ *          and the size of the response in bytes, e.g.
+ *              0.000 1048576
+ *              0.002 512
+ *          Blank lines and lines starting with # are skipped.  Requests are
+ *          served one turn at a time as in sws: the policy picks a request,
+ *          the request sends up to its quantum at the link bandwidth, and
+ *          goes back to the policy until its last byte is sent.  The
+ *          response time of a request runs from its arrival to its last
+ *          byte, and its slowdown is the response time over the time the
+ *          request would take alone on the link.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "sched.h"
+
+#define USAGE "usage: sws-sim [-q quantum] [-l quantum,quantum,...] [-a aging]\n" \
+              "               [-w bandwidth] <scheduler> [trace]\n" \
+              "       without a trace file, the trace is read from stdin\n" \
+              "       -a is the bytes per second of credit an SRPT request earns\n" \
+              "       while it waits (default 65536); more bounds how long large\n" \
+              "       files wait but makes SRPT closer to FIFO, 0 is pure SRPT\n"
+
+
+/* This function compares two requests by arrival for qsort().
+ * Parameters:
+ *             a, b : the requests
+ * Returns: <0, 0 or >0 as a arrives before, with or after b.
+ */
+static int compare_arrivals( const void *a, const void *b ) {
+  const RequestControlBlock *x = a;
+  const RequestControlBlock *y = b;
+
+  if( x->arrived != y->arrived ) {
+    return x->arrived < y->arrived ? -1 : 1;
+  }
+  return x->sequenceNumber - y->sequenceNumber;
+}
+
+
+/* This function compares two response times for qsort().
+ * Parameters:
+ *             a, b : the response times
+ * Returns: <0, 0 or >0 as a is less than, equal to or greater than b.
+ */
+static int compare( const void *a, const void *b ) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+
+  return ( x > y ) - ( x < y );
+}
+
+
+/* This function reads a trace into an array of request control blocks,
+ *    sorted by arrival.  This function will exit the program if the trace
+ *    is malformed.
+ * Parameters:
+ *             in : the trace
+ *             n  : set to the number of requests
+ * Returns: The requests, with arrived, sequenceNumber and bytesRemaining set.
+ */
+static RequestControlBlock *read_trace( FILE *in, int *n ) {
+  RequestControlBlock *blocks = NULL;
+  int capacity = 0;
+  char line[256];
+  double at;
+  long long size;
+  int lineno = 0;
+
+  for( *n = 0; fgets( line, sizeof( line ), in ); lineno++ ) {
+    if( ( line[strspn( line, " \t" )] == '#' ) || ( line[strspn( line, " \t\r\n" )] == '\0' ) ) {
+      continue;                                         /* comment or blank */
+    }
+    if( ( sscanf( line, "%lf %lld", &at, &size ) < 2 ) || ( at < 0 ) || ( size < 0 ) ) {
+      fprintf( stderr, "Error: line %d of the trace is not <seconds> <bytes>\n", lineno + 1 );
+      exit( 1 );
+    }
+    if( *n == capacity ) {
+      capacity = capacity ? capacity * 2 : 1024;
+      blocks = realloc( blocks, capacity * sizeof( RequestControlBlock ) );
+      if( !blocks ) {
+        perror( "Error while allocating memory" );
+        abort();
+      }
+    }
+    memset( &blocks[*n], 0, sizeof( RequestControlBlock ) );
+    blocks[*n].sequenceNumber = *n + 1;
+    blocks[*n].arrived = (uint64_t)( at * 1e9 );
+    blocks[*n].bytesRemaining = size;
+    (*n)++;
+  }
+  qsort( blocks, *n, sizeof( RequestControlBlock ), compare_arrivals );
+  return blocks;
+}
+
+
+/* This function prints the count, mean and percentiles of a set of
+ *    samples, sorting them.
+ * Parameters:
+ *             name : what the samples are
+ *             v    : the samples
+ *             n    : the number of samples, at least 1
+ *             unit : scale of the printed values, e.g. 1e3 for milliseconds
+ * Returns: None
+ */
+static void print_samples( const char *name, double *v, int n, double unit ) {
+  static const double points[] = { 0.5, 0.9, 0.99, 0.999 };
+  double sum = 0;
+  int i;
+
+  qsort( v, n, sizeof( double ), compare );
+  for( i = 0; i < n; i++ ) {
+    sum += v[i];
+  }
+  printf( "%-10s mean %10.3f", name, sum / n * unit );
+  for( i = 0; i < sizeof( points ) / sizeof( points[0] ); i++ ) {
+    printf( "  p%-4g %10.3f", points[i] * 100, v[(int)ceil( points[i] * n ) - 1] * unit );
+  }
+  printf( "  max %10.3f\n", v[n - 1] * unit );
+}
+
+
+int main( int argc, char **argv ) {
+  const scheduler *policy;                              /* policy to simulate */
+  sched_queue ready;                                    /* its ready queue */
+  RequestControlBlock *blocks;                          /* the trace */
+  double *response;                                     /* response of each */
+  double *slowdown;                                     /* and its slowdown */
+  double bandwidth = 125e6;                             /* link in bytes/second */
+  double now = 0;                                       /* simulated time */
+  double busy = 0;                                      /* time spent sending */
+  long long sent = 0;                                   /* bytes sent */
+  long turns = 0;                                       /* number of turns */
+  int n;                                                /* number of requests */
+  int next = 0;                                         /* next to arrive */
+  int done = 0;                                         /* requests completed */
+  FILE *in = stdin;
+  int opt;
+
+  /* parse the options, which match those of sws */
+  while( ( opt = getopt( argc, argv, "q:l:a:w:" ) ) != -1 ) {
+    switch( opt ) {
+    case 'q':
+      if( ( sscanf( optarg, "%d", &sched_quantum ) < 1 ) || ( sched_quantum < 1 ) ) {
+        printf( "Error: quantum must be a positive number of bytes\n" );
+        return 1;
+      }
+      break;
+    case 'l':
+      if( sched_parse_levels( optarg ) ) {
+        printf( "Error: levels must be a list of quanta, e.g. 8192,65536,0\n" );
+        return 1;
+      }
+      break;
+    case 'a':
+      if( ( sscanf( optarg, "%ld", &sched_aging ) < 1 ) || ( sched_aging < 0 ) ) {
+        printf( "Error: aging must be a number of bytes per second\n" );
+        return 1;
+      }
+      break;
+    case 'w':
+      if( ( sscanf( optarg, "%lf", &bandwidth ) < 1 ) || ( bandwidth <= 0 ) ) {
+        printf( "Error: bandwidth must be a positive number of bytes per second\n" );
+        return 1;
+      }
+      break;
+    default:
+      printf( USAGE );
+      return 1;
+    }
+  }
+  if( ( argc - optind < 1 ) || ( argc - optind > 2 ) ) {
+    printf( USAGE );
+    return 1;
+  }
+  policy = sched_find( argv[optind] );
+  if( !policy ) {
+    printf( "Error: unknown scheduler selected.\n" );
+    printf( "Please select one of 'RR', 'SJF', 'MLFB' or 'SRPT'\n" );
+    return 1;
+  }
+  if( ( argc - optind == 2 ) && !( in = fopen( argv[optind + 1], "r" ) ) ) {
+    perror( "Error while opening the trace" );
+    return 1;
+  }
+
+  blocks = read_trace( in, &n );
+  if( n == 0 ) {
+    printf( "Error: the trace has no requests\n" );
+    return 1;
+  }
+  response = calloc( n, sizeof( double ) );
+  slowdown = calloc( n, sizeof( double ) );
+  if( !response || !slowdown ) {
+    perror( "Error while allocating memory" );
+    abort();
+  }
+  sched_init( &ready, policy );
+
+  /* serve one turn at a time, admitting the requests that arrived first */
+  while( done < n ) {
+    RequestControlBlock *b;
+    off_t turn;
+
+    if( ready.size == 0 && now < blocks[next].arrived / 1e9 ) {
+      now = blocks[next].arrived / 1e9;                 /* idle until next */
+    }
+    while( next < n && blocks[next].arrived / 1e9 <= now ) {
+      sched_enqueue( &ready, &blocks[next++] );
+    }
+
+    b = sched_next( &ready );
+    turn = b->bytesRemaining;
+    if( b->quantum > 0 && b->quantum < turn ) {
+      turn = b->quantum;
+    }
+    now += turn / bandwidth;
+    busy += turn / bandwidth;
+    sent += turn;
+    turns++;
+    b->bytesRemaining -= turn;
+    b->offset += turn;                                  /* bytes sent so far */
+
+    while( next < n && blocks[next].arrived / 1e9 <= now ) {
+      sched_enqueue( &ready, &blocks[next++] );         /* before b goes back */
+    }
+    if( b->bytesRemaining > 0 ) {
+      sched_expired( &ready, b );
+    } else {
+      sched_complete( &ready, b );
+      response[done] = now - b->arrived / 1e9;
+      slowdown[done] = b->offset > 0 ? response[done] / ( b->offset / bandwidth ) : 1;
+      done++;
+    }
+  }
+
+  printf( "%s scheduler, %d requests, %lld bytes in %ld turns\n",
+          policy->title, n, sent, turns );
+  printf( "link %.0f bytes/s, %.3f s simulated, %.1f%% busy\n",
+          bandwidth, now, now > 0 ? 100 * busy / now : 0 );
+  print_samples( "response", response, n, 1e3 );
+  print_samples( "slowdown", slowdown, n, 1 );
+  printf( "response times are in milliseconds\n" );
+  return 0;
+}
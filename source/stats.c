@@ -0,0 +1,222 @@
+/*
+ * File: stats.c
+ * Purpose: This file contains the request statistics.
+ *          Please see stats.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "stats.h"
+
+typedef struct histogram {
+  uint64_t count;                       /* number of samples */
+  uint64_t sum;                         /* sum of samples in usec */
+  uint64_t max;                         /* largest sample in usec */
+  uint64_t buckets[STATS_BUCKETS];      /* samples by power of two */
+} histogram;
+
+static const char *scheduler = "";      /* name of the scheduler */
+static uint64_t started;                /* when the server started */
+static uint64_t requests;               /* requests completed */
+static uint64_t bytes;                  /* bytes sent to clients */
+static uint64_t shed;                   /* requests refused with 503 */
+static uint64_t sampled;                /* time of the previous report */
+static uint64_t sampled_bytes;          /* bytes at the previous report */
+static histogram queueing;              /* parsed to first byte */
+static histogram ttfb;                  /* arrived to first byte */
+static histogram completion;            /* arrived to last byte */
+
+
+extern void stats_init( const char *name ) {
+  scheduler = name;
+  started = stats_now();
+  sampled = started;
+}
+
+
+extern uint64_t stats_now( void ) {
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+extern void stats_bytes( long n ) {
+  __atomic_fetch_add( &bytes, n, __ATOMIC_RELAXED );
+}
+
+
+extern void stats_shed( void ) {
+  __atomic_fetch_add( &shed, 1, __ATOMIC_RELAXED );
+}
+
+
+/* This function adds the time between two timestamps to a histogram.
+ * Parameters:
+ *             h     : the histogram
+ *             start : the earlier timestamp
+ *             end   : the later timestamp
+ * Returns: None
+ */
+static void add( histogram *h, uint64_t start, uint64_t end ) {
+  uint64_t us = end > start ? ( end - start ) / 1000 : 0;
+  uint64_t max = __atomic_load_n( &h->max, __ATOMIC_RELAXED );
+  int i = us ? 64 - __builtin_clzll( us ) : 0;          /* us < 2^i */
+
+  if( i >= STATS_BUCKETS ) {
+    i = STATS_BUCKETS - 1;
+  }
+  __atomic_fetch_add( &h->buckets[i], 1, __ATOMIC_RELAXED );
+  __atomic_fetch_add( &h->sum, us, __ATOMIC_RELAXED );
+  __atomic_fetch_add( &h->count, 1, __ATOMIC_RELAXED );
+  while( us > max && !__atomic_compare_exchange_n( &h->max, &max, us, 1,
+                                                   __ATOMIC_RELAXED,
+                                                   __ATOMIC_RELAXED ) );
+}
+
+
+extern void stats_record( uint64_t arrived, uint64_t parsed, uint64_t first,
+                          uint64_t last ) {
+  add( &queueing, parsed, first );
+  add( &ttfb, arrived, first );
+  add( &completion, arrived, last );
+  __atomic_fetch_add( &requests, 1, __ATOMIC_RELAXED );
+}
+
+
+/* This function estimates a percentile of a histogram as the upper bound
+ *    of the bucket it falls in, but no more than the largest sample.
+ * Parameters:
+ *             h       : a snapshot of the histogram
+ *             percent : the percentile
+ * Returns: The percentile in usec.
+ */
+static uint64_t percentile( histogram *h, int percent ) {
+  uint64_t rank = ( h->count * percent + 99 ) / 100;   /* rounded up */
+  uint64_t seen = 0;
+  int i;
+
+  for( i = 0; i < STATS_BUCKETS - 1; i++ ) {
+    seen += h->buckets[i];
+    if( seen >= rank ) {
+      break;
+    }
+  }
+  return ( 1ull << i ) < h->max ? 1ull << i : h->max;
+}
+
+
+/* This function appends formatted text to a report, never past its end.
+ * Parameters:
+ *             buf  : the report
+ *             size : the size of buf
+ *             len  : the length of the report so far, updated
+ *             fmt  : printf style format, followed by its arguments
+ * Returns: None
+ */
+static void append( char *buf, int size, int *len, const char *fmt, ... ) {
+  va_list ap;
+  int n;
+
+  if( *len >= size - 1 ) {
+    return;
+  }
+  va_start( ap, fmt );
+  n = vsnprintf( buf + *len, size - *len, fmt, ap );
+  va_end( ap );
+  *len += n < size - *len ? n : size - *len - 1;
+}
+
+
+/* This function appends one histogram to a report.
+ * Parameters:
+ *             buf  : the report
+ *             size : the size of buf
+ *             len  : the length of the report so far, updated
+ *             json : non-zero for JSON
+ *             name : the name of the histogram
+ *             live : the histogram
+ * Returns: None
+ */
+static void append_histogram( char *buf, int size, int *len, int json,
+                              const char *name, histogram *live ) {
+  histogram h;                                          /* snapshot */
+  int i, top = 0;
+
+  for( i = 0; i < STATS_BUCKETS; i++ ) {
+    h.buckets[i] = __atomic_load_n( &live->buckets[i], __ATOMIC_RELAXED );
+    if( h.buckets[i] ) {
+      top = i + 1;
+    }
+  }
+  h.count = __atomic_load_n( &live->count, __ATOMIC_RELAXED );
+  h.sum = __atomic_load_n( &live->sum, __ATOMIC_RELAXED );
+  h.max = __atomic_load_n( &live->max, __ATOMIC_RELAXED );
+
+  append( buf, size, len, json
+          ? ",\n  \"%s_usec\": { \"count\": %llu, \"mean\": %llu, \"p50\": %llu, "
+            "\"p90\": %llu, \"p99\": %llu, \"max\": %llu, \"buckets\": ["
+          : "%-16s %10llu %10llu %10llu %10llu %10llu %10llu\n",
+          name, (unsigned long long)h.count,
+          (unsigned long long)( h.count ? h.sum / h.count : 0 ),
+          (unsigned long long)percentile( &h, 50 ),
+          (unsigned long long)percentile( &h, 90 ),
+          (unsigned long long)percentile( &h, 99 ),
+          (unsigned long long)h.max );
+  if( json ) {                                          /* bucket i is < 2^i */
+    for( i = 0; i < top; i++ ) {
+      append( buf, size, len, "%s%llu", i ? ", " : "",
+              (unsigned long long)h.buckets[i] );
+    }
+    append( buf, size, len, "] }" );
+  }
+}
+
+
+extern int stats_report( char *buf, int size, int json, int queued,
+                         int connections ) {
+  uint64_t now = stats_now();
+  uint64_t total = __atomic_load_n( &bytes, __ATOMIC_RELAXED );
+  uint64_t since = __atomic_exchange_n( &sampled, now, __ATOMIC_RELAXED );
+  uint64_t before = __atomic_exchange_n( &sampled_bytes, total, __ATOMIC_RELAXED );
+  double uptime = ( now - started ) / 1e9;
+  double interval = ( now - since ) / 1e9;
+  double rate = uptime > 0 ? total / uptime : 0;
+  double recent = interval > 0 ? ( total - before ) / interval : 0;
+  int len = 0;
+
+  buf[0] = '\0';
+  if( json ) {
+    append( buf, size, &len,
+            "{\n  \"scheduler\": \"%s\",\n  \"uptime\": %.3f,\n"
+            "  \"requests\": %llu,\n  \"shed\": %llu,\n  \"bytes\": %llu,\n"
+            "  \"bytes_per_sec\": %.0f,\n  \"recent_bytes_per_sec\": %.0f,\n"
+            "  \"queue_depth\": %d,\n  \"connections\": %d",
+            scheduler, uptime,
+            (unsigned long long)__atomic_load_n( &requests, __ATOMIC_RELAXED ),
+            (unsigned long long)__atomic_load_n( &shed, __ATOMIC_RELAXED ),
+            (unsigned long long)total, rate, recent, queued, connections );
+  } else {
+    append( buf, size, &len,
+            "scheduler:        %s\nuptime:           %.3f s\n"
+            "requests:         %llu\nshed:             %llu\nbytes:            %llu\n"
+            "bytes/sec:        %.0f\nrecent bytes/sec: %.0f\n"
+            "queue depth:      %d\nconnections:      %d\n\n"
+            "%-16s %10s %10s %10s %10s %10s %10s\n",
+            scheduler, uptime,
+            (unsigned long long)__atomic_load_n( &requests, __ATOMIC_RELAXED ),
+            (unsigned long long)__atomic_load_n( &shed, __ATOMIC_RELAXED ),
+            (unsigned long long)total, rate, recent, queued, connections,
+            "latency (usec)", "count", "mean", "p50", "p90", "p99", "max" );
+  }
+  append_histogram( buf, size, &len, json, "queueing", &queueing );
+  append_histogram( buf, size, &len, json, "ttfb", &ttfb );
+  append_histogram( buf, size, &len, json, "completion", &completion );
+  if( json ) {
+    append( buf, size, &len, "\n}\n" );
+  }
+  return len;
+}
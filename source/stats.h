@@ -0,0 +1,92 @@
+/*
+ * File: stats.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          statistics module, which keeps latency histograms and throughput
+ *          counters of the requests served, for the /__stats page.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+/*
+ * This module has six functions:
+ *   stats_init()   : inititalizes the statistics
+ *   stats_now()    : read the monotonic clock
+ *   stats_bytes()  : count bytes sent to a client
+ *   stats_shed()   : count a request refused because of overload
+ *   stats_record() : add a completed request to the histograms
+ *   stats_report() : format the statistics as plain text or JSON
+ *
+ * Each request is timestamped when it arrives, when it has been parsed, and
+ * when its first and last bytes have been sent.  Three latencies are kept:
+ * queueing delay (parsed to first byte), time to first byte (arrived to
+ * first byte) and completion time (arrived to last byte).  Each is kept in
+ * a histogram with power-of-two buckets in microseconds.  Updates use
+ * atomic operations only, so recording never takes a lock and never blocks
+ * a worker thread.
+ */
+
+#define STATS_PATH "__stats"            /* reserved path of the stats page */
+#define STATS_BUCKETS 40                /* bucket i holds < 2^i usec */
+
+
+/* This function initializes the statistics.  It should be called once,
+ *    before any other function of this module.
+ * Parameters:
+ *             scheduler : the name of the scheduler, for the report
+ * Returns: None
+ */
+extern void stats_init( const char *scheduler );
+
+
+/* This function reads the monotonic clock.
+ * Parameters: None
+ * Returns: The time in nanoseconds since an arbitrary point.
+ */
+extern uint64_t stats_now( void );
+
+
+/* This function counts bytes sent to a client, for the throughput.
+ * Parameters:
+ *             bytes : the number of bytes sent
+ * Returns: None
+ */
+extern void stats_bytes( long bytes );
+
+
+/* This function counts a request or connection that was answered with 503
+ *    because the server was overloaded or the client over its rate.
+ * Parameters: None
+ * Returns: None
+ */
+extern void stats_shed( void );
+
+
+/* This function adds a completed request to the histograms.
+ * Parameters:
+ *             arrived : when the request arrived
+ *             parsed  : when the request was parsed
+ *             first   : when the first byte of the response was sent
+ *             last    : when the last byte of the response was sent
+ * Returns: None
+ */
+extern void stats_record( uint64_t arrived, uint64_t parsed, uint64_t first,
+                          uint64_t last );
+
+
+/* This function formats the statistics.  The gauges are sampled by the
+ *    caller, since this module does not know about the server's queues.
+ * Parameters:
+ *             buf         : the buffer to format into
+ *             size        : the size of buf
+ *             json        : non-zero for JSON, zero for plain text
+ *             queued      : the number of requests in the ready queue
+ *             connections : the number of open connections
+ * Returns: The length of the report, truncated to fit in buf.
+ */
+extern int stats_report( char *buf, int size, int json, int queued,
+                         int connections );
+
+#endif
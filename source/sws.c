@@ -7,45 +7,166 @@
  *          processes each client request.
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/socket.h>
 
 #include "network.h"
+#include "sws.h"
+#include "queue.h"
+#include "cache.h"
+#include "fdcache.h"
+#include "http.h"
+#include "pool.h"
+#include "stats.h"
+#include "transfer.h"
+#include "header.h"
+#include "gzip.h"
+#include "sched.h"
+#include "trace.h"
+#include "ratelimit.h"
+#include "wheel.h"
+#include "disk.h"
 
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 
 #define MAX_HTTP_SIZE 8192                 /* size of buffer to allocate */
 
-typedef struct RequestControlBlock{
-   // This is the request control table to store state info for each request by
-   // the client.
-   // It should be initialized as an array of RequestControlTables and
-   // should associate a spot in the array with a request from the client
-
-   int sequenceNumber;  //similar to process ID. sequence numbers start at 1
-   int fileDescriptor;  //returned by network_wait() in network.h
-   FILE * fileName;     //filename given by the client
-   int bytesRemaining;  //the number of bytes remaining to be sent
-   int quantum;         //max number of bytes to send
-
-   char fname[100];        // req name of file
-
-}RequestControlBlock; 
-
-
-bool rr = false;
-bool sjf = false;
-bool mlfb = false;
-
-pthread_mutex_t mutex;
-pthread_cond_t condition;
-
-int seqCounter = 1; //sequence counter. increments for each request
+#define CACHE_SIZE (32 << 20)              /* default content cache size */
+#define CACHE_MAX_OBJECT (256 << 10)       /* largest file to cache */
+#define FILE_BUDGET 256                    /* default files kept open */
+#define GZIP_SIZE (16 << 20)               /* gzipped copies to keep */
+#define GZIP_MAX_OBJECT (4 << 20)          /* largest file to gzip */
+#define TRACE_RECORDS (1 << 20)            /* records kept by -t, 64 MB */
+
+#define SHARD_BATCH 64                     /* turns served between polls */
+#define TIMER_TICK 100                     /* ms per tick of the timer wheels */
+#define SEND_GRACE 10000                   /* ms a turn may take beyond -R */
+#define RETRY_AFTER "Retry-After: 1\r\n"   /* when to come back after a 503 */
+#define DISK_THREADS 4                     /* default size of the disk pool */
+#define READAHEAD (256 << 10)              /* bytes of a file to prefetch */
+
+#define USAGE "usage: sws [-q quantum] [-l quantum,quantum,...] [-a aging] [-c cachebytes]\n" \
+              "           [-k keepalive] [-H headertimeout] [-R minrate] [-b backlog]\n" \
+              "           [-m requests] [-Q bytes,bytes,...] [-r rate[,burst]]\n" \
+              "           [-t tracefile] [-i diskthreads] [-f openfiles] [-s] [-u]\n" \
+              "           <port> <scheduler> <threads>\n" \
+              "       -a is the bytes per second of credit an SRPT request earns\n" \
+              "       while it waits (default 65536); more bounds how long large\n" \
+              "       files wait but makes SRPT closer to FIFO, 0 is pure SRPT\n"
+
+
+
+const scheduler * policy;       //scheduling policy, from the command line
+
+typedef struct Connection{
+   // State of a persistent client connection. Requests pipelined on the
+   // connection become separate control blocks, but only one of them is
+   // in the scheduler at a time so responses go out in order. All fields
+   // except buffer and length are guarded by the shard's mutex; those two
+   // belong to the worker reading the connection.
+
+   int fd;                   //client file descriptor from network_poll()
+   struct Shard * shard;     //shard whose lock and queues the connection uses
+   char * buffer;            //bytes read from the client but not yet parsed,
+                             //from the buffer pool while there are any
+   int length;               //number of bytes in buffer
+   uint64_t arrived;         //when the first unparsed request arrived, 0 if
+                             //none; set by the main thread while not queued
+   int refs;                 //table entry, work items and blocks using it
+   bool queued;              //in the work queue or being read by a worker
+   bool active;              //one of its blocks is in the scheduler
+   bool lastRequest;         //no more requests will be read or served
+   bool closed;              //socket has been closed
+   fifo waiting;             //pipelined blocks waiting for the active one
+   RequestControlBlock * parked;   //active block waiting for room in the
+                                   //client's send buffer, NULL if none
+   timer deadline;           //when the connection is closed unless the
+                             //client sends its request or takes its data
+   struct Connection * workNext;   //next connection in the work queue
+   http_parser parser;       //parser of the request at the start of buffer
+
+}Connection;
+
+
+typedef struct Shard{
+   // A shard is a set of connections with its own lock, work queue, ready
+   // queue and timer wheel. By default there is a single shard, which the
+   // main thread polls and every worker serves. With -s, each worker owns
+   // a shard with its own listening socket, and polls and serves it alone
+   // on its own CPU, so a request never leaves the core that accepted it.
+
+   int index;                //network shard of the connections
+   pthread_mutex_t mutex;    //guards the queues and the connections
+   pthread_cond_t condition; //signalled on new work
+   Connection * workHead;    //work queue of readable connections
+   Connection * workTail;
+   wheel timers;             //deadlines of the connections
+   sched_queue ready;        //scheduler's ready queue
+
+}Shard;
+
+
+typedef struct OpenJob{
+   // A request whose file is being opened by the disk pool. The request
+   // is copied out of the connection's buffer, which goes on to the next
+   // request, and its parser is pointed at the copy.
+
+   disk_job job;             //job of the disk pool, owned by this
+   RequestControlBlock * b;  //the request
+   char * req;               //its path, in buffer
+   char * buffer;            //copy of the request, from the buffer pool
+   http_parser parser;       //parser of the copy
+
+}OpenJob;
+
+
+Shard * shards;                 //one, or one per worker with -s
+int numShards = 1;              //size of shards
+bool sharded = false;           //-s, one listener and CPU per worker
+bool uring = false;             //-u, io_uring instead of epoll
+int backlog = NETWORK_BACKLOG;  //length of each listen queue
+int diskThreads = DISK_THREADS; //-i, threads that open files, 0 to open
+                                //them in the worker that reads the request
+
+Connection ** connections;      //open connections, indexed by fd
+int maxConnections;             //size of connections
+int numConnections = 0;         //number of open connections, atomic
+int keepAliveTimeout = 5;       //seconds before an idle connection is closed
+int headerTimeout = 10;         //-H, seconds a client has to send a request
+int minRate = 1024;             //-R, bytes per second a client must take,
+                                //0 for no limit
+
+int maxRequests = 0;            //-m, requests in the server before new ones
+                                //are refused, 0 for no limit
+int inFlight = 0;               //requests parsed and not yet released, atomic
+long * levelLimit = NULL;       //-Q, bytes queued at each scheduler level
+int numLevelLimits = 0;         //before new requests are refused; the last
+                                //one applies to any further levels
+
+const char overloadResponse[] = //sent when a request is refused
+   "HTTP/1.1 503 Service Unavailable\r\n" RETRY_AFTER
+   "Content-Length: 0\r\nConnection: close\r\n\r\n";
+
+slab blockSlab = SLAB_INITIALIZER( sizeof( RequestControlBlock ), 256 );
+slab connectionSlab = SLAB_INITIALIZER( sizeof( Connection ), 64 );
+slab bufferSlab = SLAB_INITIALIZER( MAX_HTTP_SIZE, 16 );   //I/O buffers
+slab openSlab = SLAB_INITIALIZER( sizeof( OpenJob ), 16 );
+
+int seqCounter = 1; //sequence counter. increments atomically for each request
 
 /* This function takes a file handle to a client, reads in the request, 
  *    parses the request, and sends back the requested file.  If the
@@ -124,199 +245,1062 @@ static void serve_client( int fd ) {
 
 }
 
-RequestControlBlock process_client(RequestControlBlock newBlock) {
-   //This function initializes a control block entry to be processed
-   //in the request control table, and later served by serve_client
+int normalize_path( char * path ) {
+   //Normalizes a requested path in place so it can be used as a cache key:
+   //the leading / is skipped, any query string is dropped, and repeated
+   //slashes and "." segments are removed. Paths that climb out of the
+   //served directory with ".." are rejected.
+   //Returns 0 on success, -1 if the path is rejected.
+
+   char * in = path;                                 /* next char to read */
+   char * out = path;                                /* next char to write */
+   char * seg;                                       /* start of segment */
+   int rejected = 0;
+
+   while( *in && *in != '?' ) {
+      while( *in == '/' ) {                          /* skip slashes */
+         in++;
+      }
+      seg = in;
+      while( *in && *in != '/' && *in != '?' ) {
+         in++;
+      }
+      if( in - seg == 1 && seg[0] == '.' ) {         /* drop "." */
+         continue;
+      }
+      if( in - seg == 2 && seg[0] == '.' && seg[1] == '.' ) {
+         rejected = -1;                              /* refuse ".." */
+      }
+      if( in > seg ) {
+         if( out > path ) {
+            *out++ = '/';
+         }
+         memmove( out, seg, in - seg );
+         out += in - seg;
+      }
+   }
+   *out = '\0';
 
-   static char *buffer;                              /* request buffer */
-   FILE *fin;                                        /* input file handle */
-   char *req = NULL;                                 /* ptr to req file */
-   char *brk;                                        /* state used by strtok */
-   char *tmp;                                        /* error checking ptr */
+   return rejected;
+}
 
-   int fd = newBlock.fileDescriptor;
-   network_open();
 
-   //check file to init control block
-   buffer = malloc( MAX_HTTP_SIZE );
-   read( fd, buffer, MAX_HTTP_SIZE ) ;
-   tmp = strtok_r( buffer, " ", &brk );
-   if( tmp && !strcmp( "GET", tmp ) ) {
-      req = strtok_r( NULL, " ", &brk );
+char * read_request( RequestControlBlock * b, http_parser * p ) {
+   //Fills in a control block from a parsed request: the status is 400 if
+   //the request is not a GET, and keepAlive follows the HTTP version and
+   //the Connection: header. The path is terminated in place.
+   //Returns the requested path, or NULL if the request is bad.
+
+   http_slice * conn = http_header( p, "Connection" );
+
+   /* standard requests are of the form
+    *   GET /foo/bar/qux.html HTTP/1.1
+    * We want the second token (the file path).
+    */
+   b->keepAlive = p->version.len > 0 && !http_equals( &p->version, "HTTP/1.0" );
+   if( conn && http_has_token( conn, "close" ) ) {
+      b->keepAlive = false;
+   } else if( conn && http_has_token( conn, "keep-alive" ) ) {
+      b->keepAlive = true;
    }
-   req++;
 
-   fin = fopen( req, "r" );  
+   if( !http_equals( &p->method, "GET" ) ) {
+      b->status = 400;
+      b->keepAlive = false;
+      return NULL;
+   }
+
+   b->status = 200;
+   p->target.p[p->target.len] = '\0';               /* ends with space or LF */
+   return p->target.p;
+}
+
+
+int readySize(Shard * s){
+   //Returns the number of blocks in a shard's ready queue
 
-   //file = fileno(fin);
+   return s->ready.size;
+}
 
-   struct stat finfo;
-   if (stat(req, &finfo) == 0) {
 
-      newBlock.sequenceNumber = seqCounter;
-      newBlock.fileName = fin;
-      newBlock.bytesRemaining = finfo.st_size;
+void open_stats( RequestControlBlock * b, bool json ) {
+   //Generates the stats page into an I/O buffer as the body of a block.
+   //The queue depth is summed over the shards with each one's mutex held.
 
-      strcpy(newBlock.fname, req);
+   int queued = 0;
+   int i;
 
-      if (sjf && !rr && !mlfb){
-         newBlock.quantum = finfo.st_size;
+   for( i = 0; i < numShards; i++ ) {
+      pthread_mutex_lock( &shards[i].mutex );
+      queued += readySize( &shards[i] );
+      pthread_mutex_unlock( &shards[i].mutex );
+   }
+
+   b->body = slab_alloc( &bufferSlab );
+   b->bytesRemaining = stats_report( b->body, MAX_HTTP_SIZE, json, queued,
+                                     __atomic_load_n( &numConnections, __ATOMIC_RELAXED ) );
+   snprintf( b->fname, sizeof( b->fname ), "%s", STATS_PATH );
+}
+
+
+file_header * block_header( RequestControlBlock * b ) {
+   //Returns the cached response headers of the file a block sends, or NULL
+   //if the block has no file, e.g. the stats page or an error
+
+   if( b->cached ) {
+      return &b->cached->header;
+   }
+   if( b->gzipped ) {
+      return &b->gzipped->header;
+   }
+   if( b->file ) {
+      return &b->file->header;
+   }
+   return b->transfer ? &b->transfer->t->header : NULL;
+}
+
+
+void open_request( RequestControlBlock * b, char * req, http_parser * p ) {
+   //This function initializes a control block entry to be processed
+   //in the request control table, and later served by serve_client2.
+   //Sets the status to 404 if the file cannot be opened, and to 304 if the
+   //request is conditional and the client's copy is current.
+
+   // hot files come from the content cache, anything else from the open
+   // file cache
+   fdcache_entry * file = NULL;                      /* file if not cached */
+   file_header * raw = NULL;                         /* headers of the file */
+   file_header * h;                                  /* headers sent */
+   off_t first = 0, last = 0;                        /* requested range */
+   off_t size = 0;                                   /* bytes of the body */
+   int range = 0;                                    /* from header_range */
+   char * query = req ? strchr( req, '?' ) : NULL;   /* e.g. ?format=json */
+   bool json = query && strstr( query, "json" );
+   bool gzip;                                        /* may send gzipped */
+   b->cached = NULL;
+   b->gzipped = NULL;
+   b->body = NULL;
+   b->transfer = NULL;
+   b->file = NULL;
+   b->offset = 0;
+   b->headerSent = false;
+   b->bytesRemaining = 0;
+   b->fname[0] = '\0';
+   b->level = 0;
+
+   if (b->status == 200 && normalize_path(req) == 0) {
+      if (strcmp(req, STATS_PATH) == 0) {
+         open_stats(b, json);
+      } else {
+         b->cached = cache_get(req, &file);
       }
-      else if (rr && !sjf && !mlfb){
-         // do round robin quantum
-         newBlock.quantum = 8192;
+   }
+   gzip = (b->cached || file) && header_compressible(req) && gzip_accepted(p);
+   if (b->cached) {
+      raw = &b->cached->header;
+   } else if (file) {
+      raw = &file->header;
+   }
+
+   // text goes out gzipped if the client takes it and a copy is ready
+   if (gzip) {
+      b->gzipped = gzip_get(req, raw);
+   }
+   if (b->gzipped) {
+      if (b->cached) {
+         cache_release(b->cached);
+         b->cached = NULL;
+      } else {
+         fdcache_release(file);
       }
-      else if (mlfb && !sjf && !rr) {
-         // do mlfb quantum
+      size = b->gzipped->size;
+   } else if (b->cached) {
+      size = b->cached->size;
+   } else if (file) {
+      size = file->st.st_size;
+      b->file = file;                                /* until a body is due */
+   }
+
+   h = block_header(b);
+   if (h) {
+
+      // the job size is the size of what is sent, e.g. the gzipped copy
+      b->bytesRemaining = size;
+
+      snprintf(b->fname, sizeof(b->fname), "%s", req);
+
+      range = header_range(h, p, &first, &last);
+      if (header_not_modified(h, p)) {             /* repeat visitors get */
+         b->status = 304;                            /* the headers alone */
+         b->bytesRemaining = 0;
+      } else if (range > 0) {                        /* the scheduler sees */
+         b->status = 206;                            /* only the range */
+         b->offset = first;
+         b->bytesRemaining = last - first + 1;
+      } else if (range < 0) {
+         b->status = 416;
+         b->bytesRemaining = 0;
       }
+   }
+   else if (b->status == 200 && !b->body) {
+      b->status = 404;
+   }
 
+   // concurrent requests for the file share one read from the disk, unless
+   // they only want a part that starts further in; a 304 or a 416 sends no
+   // body, so it keeps the open file just for its headers
+   if (b->file && b->bytesRemaining > 0) {
+      b->transfer = transfer_join(req, b->file, b->offset);
+      b->file = NULL;
    }
-   else {
-      printf("Error accessing file :(\n");
-      abort();
+   b->size = b->bytesRemaining;
+}
+
+
+void open_job( disk_job * j ) {
+   //Runs on a thread of the disk pool: opens the file of a request as
+   //open_request does, and asks the kernel to start reading the first part
+   //of it, so the worker that sends it finds it in the page cache.
+
+   OpenJob * o = j->owner;
+   RequestControlBlock * b = o->b;
+
+   open_request( b, o->req, &o->parser );
+   if( b->transfer ) {
+      posix_fadvise( b->transfer->t->fd, b->offset, READAHEAD, POSIX_FADV_WILLNEED );
    }
+}
 
-   fclose( fin );
 
-   //close( fd );                                     /* close client connectuin*/
+OpenJob * open_later( Connection * conn, RequestControlBlock * b, char * req ) {
+   //Prepares a job for the disk pool to open the file of a request that
+   //has just been parsed from a connection's buffer, or returns NULL if
+   //the request needs no file, or there is no pool, so it can be opened
+   //right away.
+
+   OpenJob * o;
 
-   return newBlock;
+   if( diskThreads <= 0 || b->status != 200 ) {
+      return NULL;
+   }
+   o = slab_alloc( &openSlab );
+   o->job.run = open_job;
+   o->job.shard = conn->shard->index;
+   o->job.owner = o;
+   o->b = b;
+   o->buffer = slab_alloc( &bufferSlab );
+   memcpy( o->buffer, conn->buffer, conn->parser.pos );
+   o->parser = conn->parser;
+   http_move( &o->parser, conn->buffer, o->buffer );
+   o->req = o->buffer + ( req - conn->buffer );
+   b->opening = true;
+   return o;
 }
 
 
-RequestControlBlock serve_client2( RequestControlBlock rcb ) {
-   //This is our attempt at serving the client while utilizing the blocks
-   //from the control table.
-   //
-   //If this method didnt segfault we believe that we would have SJF and RR
-   //functioning correctly. 
-   //
-   //(Please dont take all of our marks away because of a segfault :)
+void free_open( OpenJob * o ) {
+   //Gives a job of the disk pool and its copy of the request back
 
-   int fd = rcb.fileDescriptor;
+   slab_free( &bufferSlab, o->buffer );
+   slab_free( &openSlab, o );
+}
 
-   static char *buffer;                              /* request buffer */
-   //char *req = rcb.fname;                                 /* ptr to req file */
-   //char *brk;                                        /* state used by strtok */
-   //char *tmp;                                        /* error checking ptr */
-   FILE *fin;// = rcb.fileName;                                        /* input file handle */
-   int len;                                          /* length of data read */
-   char ch;
 
-   if( !buffer ) {                                   // 1st time, alloc buffer 
-      buffer = malloc( MAX_HTTP_SIZE );
-      if( !buffer ) {                                 // error check 
-         perror( "Error while allocating memory" );
-         abort();
-      }
+const char * status_text( int status ) {
+   //Returns the reason phrase sent with a status code
+
+   switch( status ) {
+   case 200: return "OK";
+   case 206: return "Partial Content";
+   case 304: return "Not modified";
+   case 400: return "Bad request";
+   case 404: return "File not found";
+   case 414: return "URI too long";
+   case 416: return "Range not satisfiable";
+   case 431: return "Request header fields too large";
+   case 503: return "Service Unavailable";
+   default: return "Error";
    }
-   memset( buffer, 0, MAX_HTTP_SIZE );
+}
 
-   fin = fopen( rcb.fname, "r" );                        // open file 
 
-   len = sprintf( buffer, "HTTP/1.1 200 OK\n\n" );/* send success code */
+void serve_client2( RequestControlBlock * rcb ) {
+   //Serves one turn of a request: sends at most rcb->quantum bytes of the
+   //file starting at rcb->offset, and advances the offset and bytesRemaining
+   //by what was sent. A quantum of 0 or less sends the rest of the file.
+   //The caller requeues the block until bytesRemaining reaches 0.
+   //Nothing waits for the client: if its send buffer fills, the turn stops
+   //with rcb->blocked set, having counted only the bytes the kernel took,
+   //and the next call goes on from there, even part way through the header.
+
+   char buffer[160];                                 /* header buffer */
+   char line[32];                                    /* Connection: line */
+   struct iovec iov[4];                              /* header and body */
+   char * body = rcb->cached ? rcb->cached->data      /* in memory */
+               : rcb->gzipped ? rcb->gzipped->data : rcb->body;
+   file_header * h = block_header( rcb );            /* cached header */
+   int n = 0;                                        /* iovecs of header */
+   int first = 0;                                    /* 1st iovec to send */
+   int hlen = 0;                                     /* length of header */
+   int head;                                         /* header bytes sent */
+   int len = 0;                                      /* length of data sent */
+   int sent;                                         /* all bytes sent */
+   int skip;
+   int count = rcb->bytesRemaining < INT_MAX ? rcb->bytesRemaining : INT_MAX;
+
+   if (rcb->quantum > 0 && rcb->quantum - rcb->turnSent < count){
+      count = rcb->quantum - rcb->turnSent;          /* bytes for this turn */
+   }
 
-   do {/* loop, read & send file */
-      int pch = 0;
-      //len = fread( buffer, 1, MAX_HTTP_SIZE, fin );  /* read file chunk */
-      while( (ch = fgetc(fin) ) != EOF ){
-         buffer[pch] = ch;
-         pch++;
-      }
+   if( !rcb->headerSent && h && rcb->status == 206 ) {   /* 1st turn, send */
+      iov[n].iov_base = buffer;                      /* header of range */
+      iov[n].iov_len = snprintf( buffer, sizeof( buffer ),
+                                 "HTTP/1.1 206 Partial Content\r\nContent-Length: %lld\r\n"
+                                 "Content-Range: bytes %lld-%lld/%lld\r\n",
+                                 (long long)rcb->bytesRemaining, (long long)rcb->offset,
+                                 (long long)( rcb->offset + rcb->bytesRemaining - 1 ),
+                                 (long long)h->size );
+      hlen = iov[n++].iov_len;
+      iov[n].iov_base = h->ok + h->fields;           /* the rest is cached */
+      iov[n].iov_len = h->ok_len - h->fields;
+      hlen += iov[n++].iov_len;
+   } else if( !rcb->headerSent && h && rcb->status == 416 ) {
+      iov[n].iov_base = buffer;
+      iov[n].iov_len = snprintf( buffer, sizeof( buffer ),
+                                 "HTTP/1.1 416 Range not satisfiable\r\nContent-Length: 0\r\n"
+                                 "Content-Range: bytes */%lld\r\n", (long long)h->size );
+      hlen = iov[n++].iov_len;
+   } else if( !rcb->headerSent && h ) {               /* all cached */
+      iov[n].iov_base = rcb->status == 304 ? h->not_modified : h->ok;
+      iov[n].iov_len = rcb->status == 304 ? h->not_modified_len : h->ok_len;
+      hlen = iov[n++].iov_len;
+   }
+   if( !rcb->headerSent && h ) {
+      iov[n].iov_base = line;
+      iov[n].iov_len = snprintf( line, sizeof( line ), "Connection: %s\r\n\r\n",
+                                 rcb->keepAlive ? "keep-alive" : "close" );
+      hlen += iov[n++].iov_len;
+   } else if( !rcb->headerSent ) {                   /* status page or error */
+      iov[n].iov_base = buffer;
+      iov[n].iov_len = snprintf( buffer, sizeof( buffer ),
+                                 "HTTP/1.1 %d %s\r\n%sContent-Length: %lld\r\nConnection: %s\r\n\r\n",
+                                 rcb->status, status_text( rcb->status ),
+                                 rcb->status == 503 ? RETRY_AFTER : "",
+                                 (long long)rcb->bytesRemaining,
+                                 rcb->keepAlive ? "keep-alive" : "close" );
+      hlen = iov[n++].iov_len;
+   }
 
-      len = pch;
+   // the header is built the same way every turn until it is all sent, so
+   // a turn that blocked part way through it skips what already went out
+   hlen -= rcb->headerOffset;
+   for( skip = rcb->headerOffset; skip > 0; first++ ) {
+      if( skip < iov[first].iov_len ) {
+         iov[first].iov_base = (char *)iov[first].iov_base + skip;
+         iov[first].iov_len -= skip;
+         break;
+      }
+      skip -= iov[first].iov_len;
+   }
 
-      if( len < 0 ) {                             /* check for errors */
-         perror( "Error while writing to client" );
-      } 
-      else if( len > 0 ) {                      /* if none, send chunk */
-         len = write( rcb.fileDescriptor, buffer, len );
-         if( len < 1 ) {                           /* check for errors */
-            perror( "Error while writing to client" );
-         }
+   if( body ) {                                       /* one writev from memory */
+      iov[n].iov_base = body + rcb->offset;
+      iov[n].iov_len = count;
+      sent = network_sendv( rcb->fileDescriptor, iov + first, n + 1 - first );
+   } else {
+      sent = hlen ? network_sendv( rcb->fileDescriptor, iov + first, n - first ) : 0;
+      if( sent == hlen ) {                           /* header is out */
+         len = transfer_send( rcb->transfer, rcb->fileDescriptor, &rcb->offset, count );
+         sent = len < 0 ? -1 : hlen + len;
       }
+   }
+   head = sent < hlen ? sent : hlen;
+   len = sent - head;
+   rcb->blocked = sent >= 0 && ( head < hlen || len < count ) && errno == EAGAIN;
+
+   if( sent >= 0 ) {                                 /* count what the */
+      if( head == hlen ) {                           /* kernel took */
+         rcb->headerSent = true;
+         rcb->headerOffset = 0;
+      } else {
+         rcb->headerOffset += head;
+      }
+      if( body ) {
+         rcb->offset += len;
+      }
+      rcb->bytesRemaining -= len;
+      rcb->turnSent = rcb->blocked ? rcb->turnSent + len : 0;
+      stats_bytes( sent );
+   }
+   if( !rcb->blocked && ( sent < 0 || len < count ) ) {   /* check for errors */
+      perror( "Error while writing to client" );
+      rcb->bytesRemaining = 0;                        /* give up on client */
+      rcb->keepAlive = false;
+      rcb->blocked = false;
+   }
+   if( !rcb->firstByte && ( sent != 0 || !rcb->blocked ) ) {
+      rcb->firstByte = stats_now();                  /* 1st bytes are out */
+   }
+   if( rcb->bytesRemaining == 0 && !rcb->blocked ) {
+      rcb->lastByte = stats_now();
+   }
+
+}
+
+
+void release_block( RequestControlBlock * b ) {
+   //Releases the file held by a block and gives the block back to the slab
+
+   if( b->cached ) {
+      cache_release( b->cached );
+   } else if( b->gzipped ) {
+      gzip_release( b->gzipped );
+   } else if( b->transfer ) {
+      transfer_leave( b->transfer );
+   } else if( b->file ) {
+      fdcache_release( b->file );
+   }
+   slab_free( &bufferSlab, b->body );
+   slab_free( &blockSlab, b );
+   __atomic_fetch_sub( &inFlight, 1, __ATOMIC_RELAXED );
+}
+
+
+void enqueue_block( RequestControlBlock * b ) {
+   //Adds a processed control block to the scheduler's ready queue, which
+   //sets its quantum. A block whose file is still being opened is added
+   //by finish_opens() instead.
+   //Must be called with the shard's mutex held.
+
+   if( b->opening ) {
+      b->deferred = true;
+      return;
+   }
+
+   // requests for a file that is already being sent are queued too; they
+   // share its cache entry or transfer instead of reading the file again
+   b->sequenceNumber = __atomic_fetch_add( &seqCounter, 1, __ATOMIC_RELAXED );
+
+   sched_enqueue( &b->conn->shard->ready, b );
+}
+
+
+uint64_t now_ms( void ) {
+   //Returns the monotonic clock in milliseconds, the time of the wheels
+
+   return stats_now() / 1000000;
+}
+
+
+void arm_idle( Connection * conn ) {
+   //Sets the deadline of a connection that is waiting for a request. Once
+   //any of a request has arrived, the client has the header timeout from
+   //then to send the rest, however slowly it trickles in; otherwise the
+   //connection may stay open for the keep-alive timeout.
+   //Must be called with the shard's mutex held.
+
+   uint64_t deadline = conn->arrived
+                       ? conn->arrived / 1000000 + headerTimeout * 1000
+                       : now_ms() + keepAliveTimeout * 1000;
+
+   wheel_add( &conn->shard->timers, &conn->deadline, deadline );
+}
+
+
+void arm_send( Connection * conn, RequestControlBlock * b ) {
+   //Sets the deadline of a turn that is about to send to a connection:
+   //the client must take the turn's bytes at -R bytes per second, after a
+   //grace period. The deadline is cancelled once the turn is done, so a
+   //request waiting in the ready queue is not charged for the wait. A turn
+   //that blocks on a full send buffer is not done, so its deadline keeps
+   //running while it is parked and after it resumes.
+   //Must be called with the shard's mutex held.
+
+   off_t count = b->bytesRemaining;                  /* bytes of the turn */
+
+   if( minRate <= 0 ) {
+      return;
+   }
+   if( b->quantum > 0 && b->quantum < count ) {
+      count = b->quantum;
+   }
+   wheel_add( &conn->shard->timers, &conn->deadline,
+              now_ms() + SEND_GRACE + count * 1000 / minRate );
+}
+
+
+void park_block( RequestControlBlock * b ) {
+   //Takes a block whose turn stopped on a full send buffer out of the
+   //scheduler until the client makes room, so no worker waits for a slow
+   //reader while other requests are ready. The connection is watched for
+   //writing, and its send deadline still applies.
+   //Must be called with the shard's mutex held.
 
-      rcb.bytesRemaining-=rcb.quantum;
+   b->conn->parked = b;
+   network_watch( b->conn->fd, NETWORK_WRITE );
+}
 
 
-      //For round robin scheduling:
-      //break out of the loop and continue the rest of the remaining bytes 
-      //during the next loop.
-      if (rr) break;
+void resume_block( Connection * conn ) {
+   //Called by the thread polling a shard when a connection with a parked
+   //block becomes writable. The block goes back to the ready queue at its
+   //own level, to finish the quantum it started.
+   //Must be called with the shard's mutex held.
 
-   } while( len == MAX_HTTP_SIZE );              /* the last chunk < 8192 */
-   fclose( fin );
-   //}
-   //}
-   close( rcb.fileDescriptor );                                     /* close client connectuin*/
+   RequestControlBlock * b = conn->parked;
 
-   return rcb;
+   if( !b ) {
+      return;
    }
+   conn->parked = NULL;
+   sched_resume( &conn->shard->ready, b );
+   pthread_cond_signal( &conn->shard->condition );
+}
+
 
+bool overloaded( Shard * s ) {
+   //Returns true if new requests for a shard should be refused, because
+   //there are -m requests in the server or one of the shard's scheduler
+   //levels has more than its -Q bytes queued.
+   //May be called without the shard's mutex; the counts are then a
+   //little out of date, which is good enough to shed load.
 
-bool blockExists(RequestControlBlock newBlock, RequestControlBlock rct[]){
-   // check if block exists before creating a new entry
    int i;
 
-   for (i = 0; i < seqCounter-1; i++){
-      if (strcmp(newBlock.fname, rct[i].fname)==0 ){
+   if( maxRequests > 0 && __atomic_load_n( &inFlight, __ATOMIC_RELAXED ) >= maxRequests ) {
+      return true;
+   }
+   for( i = 0; numLevelLimits > 0 && i < sched_levels; i++ ) {
+      long limit = levelLimit[i < numLevelLimits ? i : numLevelLimits - 1];
+      if( limit > 0 && __atomic_load_n( &s->ready.bytes[i], __ATOMIC_RELAXED ) > limit ) {
          return true;
       }
    }
-
    return false;
 }
 
 
+void refuse_connection( int fd ) {
+   //Answers a connection that was just accepted with the precomputed 503
+   //and closes it, without reading its request or allocating anything.
+   //Called with the shard's mutex held, so it never waits: the 503 goes
+   //out in one non-blocking send, and if the socket does not take all of
+   //it the client gets what fit.
 
-int printrcb(RequestControlBlock b[]){
-   //When given a request control table, this function will print the values of
-   //the blocks populating the table
-   // mostly for debugging purposes
+   char discard[1024];
 
-   printf("Number of control blocks:\t%d\n", (seqCounter-1));
+   network_recv( fd, discard, sizeof( discard ) );   /* the request, if it */
+   send( fd, overloadResponse, sizeof( overloadResponse ) - 1,
+         MSG_DONTWAIT | MSG_NOSIGNAL );
+   network_close( fd );                              /* is here, so the close */
+   stats_shed();                                     /* is not a reset */
+}
 
-   int i;
-   for (i = 0; i < seqCounter-1; i++){
-      printf("File Name:\t%s\n", b[i].fname);
-      printf("SequenceNumber\t%d\n", b[i].sequenceNumber);
-      printf("fileDescriptor\t%d\n", b[i].fileDescriptor);
-      printf("bytes remaining\t%d\n", b[i].bytesRemaining);
-      printf("quantum\t\t%d\n", b[i].quantum);
-      printf("\n");
+
+Connection * connection_open( Shard * s, int fd ) {
+   //Called by the thread polling a shard for every connection it accepted.
+   //The new connection waits for its first request.
+   //Must be called with the shard's mutex held.
+
+   Connection * conn;
+
+   if( fd >= maxConnections ) {
+      network_close( fd );
+      return NULL;
    }
-   printf("=====================================================\n");
-   return 0;
+   conn = slab_alloc( &connectionSlab );
+   memset( conn, 0, sizeof( Connection ) );
+   conn->fd = fd;
+   conn->shard = s;
+   conn->refs = 1;                                   /* for the table entry */
+   conn->arrived = stats_now();                      /* first request is due */
+   conn->deadline.owner = conn;
+   http_init( &conn->parser, MAX_HTTP_SIZE );
+   connections[fd] = conn;
+   __atomic_fetch_add( &numConnections, 1, __ATOMIC_RELAXED );
+   arm_idle( conn );
+   return conn;
+}
+
+
+void connection_release( Connection * conn ) {
+   //Drops a reference to a connection, freeing it once it is closed and
+   //nothing uses it anymore.
+   //Must be called with the shard's mutex held.
 
+   if( --conn->refs == 0 ) {
+      free( conn->waiting.blocks );
+      slab_free( &bufferSlab, conn->buffer );
+      slab_free( &connectionSlab, conn );
+   }
 }
 
-/*
-void thread_routine()
-//Some pseudocode describing a thread routine for partial marks
 
-{
-   enter infinite loop
+void drop_waiting( Connection * conn ) {
+   //Releases the pipelined blocks of a connection that will not be served.
+   //Must be called with the shard's mutex held.
+
+   RequestControlBlock * b;
+
+   while( conn->waiting.size > 0 ) {
+      b = fifo_pop( &conn->waiting );
+      if( b->opening ) {                             /* the disk pool has it, */
+         b->dropped = true;                          /* finish_opens() frees */
+      } else {
+         release_block( b );
+      }
+      conn->refs--;                                  /* never the last ref, */
+   }                                                 /* the table holds one */
+}
+
+
+void connection_close( Connection * conn ) {
+   //Closes the socket of a connection and drops any blocks still waiting.
+   //Must be called with the shard's mutex held.
+
+   if( conn->closed ) {
+      return;
+   }
+   drop_waiting( conn );
+   wheel_remove( &conn->shard->timers, &conn->deadline );
+   conn->closed = true;
+   conn->lastRequest = true;
+   connections[conn->fd] = NULL;
+   __atomic_fetch_sub( &numConnections, 1, __ATOMIC_RELAXED );
+   network_close( conn->fd );                        /* close client connectuin*/
+   connection_release( conn );
+}
+
+
+void connection_settle( Connection * conn ) {
+   //Decides what happens to a connection once nothing is reading it and
+   //none of its blocks is in the scheduler: it is closed if the client is
+   //done, or it waits for the next request until its deadline.
+   //Must be called with the shard's mutex held.
+
+   if( conn->queued || conn->active || conn->closed ) {
+      return;
+   }
+   if( conn->lastRequest ) {
+      connection_close( conn );
+   } else {
+      arm_idle( conn );
+   }
+}
+
+
+bool admit_block( Connection * conn, RequestControlBlock * b ) {
+   //Adds a newly parsed block of a connection to the scheduler, or queues
+   //it behind the connection's active block so responses stay in order.
+   //Returns false if no more requests should be read from the connection.
+   //Must be called with the shard's mutex held.
+
+   if( conn->lastRequest ) {                         /* e.g. after close */
+      release_block( b );
+      return false;
+   }
+
+   b->conn = conn;
+   conn->refs++;
+   conn->lastRequest = !b->keepAlive;
+
+   if( conn->active ) {
+      fifo_push( &conn->waiting, b );
+   } else {
+      wheel_remove( &conn->shard->timers, &conn->deadline );
+      conn->active = true;
+      enqueue_block( b );
+      pthread_cond_signal( &conn->shard->condition );
+   }
+   return !conn->lastRequest;
+}
+
+
+void complete_block( RequestControlBlock * b ) {
+   //Releases a block once all of its bytes have been sent, and starts the
+   //next pipelined request of its connection, if any.
+   //Must be called with the shard's mutex held.
+
+   Connection * conn = b->conn;
+   bool keepAlive = b->keepAlive;
+
+   stats_record( b->arrived, b->parsed, b->firstByte, b->lastByte );
+   sched_complete( &conn->shard->ready, b );
+   release_block( b );
+   conn->active = false;
+
+   if( !keepAlive ) {                              /* client asked to close */
+      conn->lastRequest = true;                      /* or write failed */
+      drop_waiting( conn );
+   } else if( conn->waiting.size > 0 ) {
+      conn->active = true;
+      enqueue_block( fifo_pop( &conn->waiting ) );
+      pthread_cond_signal( &conn->shard->condition );
+   }
+   connection_settle( conn );
+   connection_release( conn );
+}
+
+
+void enqueue_work( Connection * conn ) {
+   //Called by the thread polling a shard when a connection becomes
+   //readable. The connection is appended to the shard's work queue and one
+   //sleeping worker is woken up.
+   //Must be called with the shard's mutex held.
+
+   if( conn->queued || conn->closed ) {
+      return;
+   }
+   if( !conn->active ) {                             /* keep a send deadline */
+      wheel_remove( &conn->shard->timers, &conn->deadline );
+   }
+   if( !conn->arrived ) {                            /* a new request */
+      conn->arrived = stats_now();
+   }
+   conn->queued = true;
+   conn->refs++;
+   conn->workNext = NULL;
+   if( conn->shard->workTail ) {
+      conn->shard->workTail->workNext = conn;
+   } else {
+      conn->shard->workHead = conn;
+   }
+   conn->shard->workTail = conn;
+   pthread_cond_signal( &conn->shard->condition );
+}
+
+
+void finish_opens( Shard * s ) {
+   //Called by the thread polling a shard when the disk pool has opened
+   //files for it. A block that was due in the scheduler meanwhile is added
+   //now; one whose connection gave up on it is released.
+   //Must be called with the shard's mutex held.
+
+   disk_job * j = disk_done( s->index );
+   disk_job * next;
+   OpenJob * o;
+
+   for( ; j; j = next ) {
+      next = j->next;
+      o = j->owner;
+      o->b->opening = false;
+      if( o->b->dropped ) {
+         release_block( o->b );
+      } else if( o->b->deferred ) {
+         enqueue_block( o->b );
+         pthread_cond_signal( &s->condition );
+      }
+      free_open( o );
+   }
+}
+
+
+void expire_timers( Shard * s ) {
+   //Acts on the connections of a shard whose deadline has passed. A
+   //connection that nothing is using is closed. A worker that is reading
+   //one closes it when it is done. A parked block is given up on at once,
+   //and a worker that is sending to one is woken up with an error, which
+   //completes and releases its block.
+   //Must be called with the shard's mutex held.
+
+   timer * t = wheel_expire( &s->timers, now_ms() );
+   timer * next;
+   Connection * conn;
+   RequestControlBlock * b;
+
+   for( ; t; t = next ) {
+      next = t->next;
+      conn = t->owner;
+      conn->lastRequest = true;
+      if( ( b = conn->parked ) ) {                   /* client stopped */
+         conn->parked = NULL;                        /* reading */
+         b->bytesRemaining = 0;
+         b->keepAlive = false;
+         b->lastByte = stats_now();
+         if( !b->firstByte ) {
+            b->firstByte = b->lastByte;
+         }
+         trace_add( b );                             /* never waits */
+         complete_block( b );
+      } else if( conn->active ) {
+         network_abort( conn->fd );                  /* stalled client */
+      } else if( !conn->queued ) {
+         connection_close( conn );                   /* idle or slow request */
+      }
+   }
+}
+
+
+void process_client( Connection * conn ) {
+   //This function reads whatever the client has sent without blocking, and
+   //feeds it to the connection's parser, which resumes where it stopped
+   //last time. Every complete request becomes a control block; pipelined
+   //requests are admitted in order. Unless the client is done, the
+   //connection is re-armed and waits for the rest of its requests.
+
+   Shard * s = conn->shard;                          /* outlives the conn */
+   RequestControlBlock * b;                          /* new control block */
+   OpenJob * job;                                    /* to open its file */
+   char * req;                                       /* ptr to req file */
+   int len;                                          /* length of request */
+   int n;                                            /* length of data read */
+   int r = HTTP_NEED_MORE;                           /* result of parsing */
+   uint64_t readAt = conn->arrived;                  /* time of last read */
+   bool done = false;                                /* stop reading */
+
+   if( !conn->buffer ) {                             /* take an I/O buffer */
+      conn->buffer = slab_alloc( &bufferSlab );
+   }
+
+   do {
+      n = network_recv( conn->fd, conn->buffer + conn->length, MAX_HTTP_SIZE - conn->length );
+      if( n > 0 ) {
+         conn->length += n;
+         readAt = stats_now();
+         if( !conn->arrived ) {                      /* arrived after the */
+            conn->arrived = readAt;                  /* last one was parsed */
+         }
+      } else if( n == 0 || ( errno != EAGAIN && errno != EINTR ) ) {
+         done = true;                                /* client closed */
+      }
+
+      // admit every complete request in the buffer
+      while( !done && ( r = http_parse( &conn->parser, conn->buffer, conn->length ) ) != HTTP_NEED_MORE ) {
+         b = slab_alloc( &blockSlab );
+         memset( b, 0, sizeof( RequestControlBlock ) );
+         b->fileDescriptor = conn->fd;
+         b->arrived = conn->arrived;
+         b->parsed = stats_now();
+         req = NULL;
+         len = conn->length;
+         if( r == HTTP_COMPLETE ) {
+            req = read_request( b, &conn->parser );
+            len = conn->parser.pos;
+            if( overloaded( s ) ) {                  /* shed, but answer */
+               b->status = 503;                      /* in order */
+               b->keepAlive = false;
+               stats_shed();
+            }
+         } else {                                    /* bad or too large */
+            b->status = conn->parser.status;
+            b->keepAlive = false;
+         }
+         __atomic_fetch_add( &inFlight, 1, __ATOMIC_RELAXED );
+         job = open_later( conn, b, req );           /* files are opened */
+         if( !job ) {                                /* by the disk pool */
+            open_request( b, req, &conn->parser );
+         }
+
+         conn->length -= len;
+         memmove( conn->buffer, conn->buffer + len, conn->length );
+         http_init( &conn->parser, MAX_HTTP_SIZE );
+         conn->arrived = conn->length > 0 ? readAt : 0;  /* pipelined rest */
+
+         pthread_mutex_lock( &conn->shard->mutex );
+         if( job && conn->lastRequest ) {            /* b is released */
+            free_open( job );
+            job = NULL;
+         }
+         done = !admit_block( conn, b );
+         pthread_mutex_unlock( &conn->shard->mutex );
+         if( job ) {                                 /* once admitted, so */
+            disk_submit( &job->job );                /* b->conn is set */
+         }
+      }
+   } while( !done && n > 0 );
+
+   if( conn->length == 0 ) {                         /* nothing left to parse, */
+      slab_free( &bufferSlab, conn->buffer );        /* so recycle the buffer */
+      conn->buffer = NULL;
+   }
+
+   pthread_mutex_lock( &s->mutex );
+   if( done ) {
+      conn->lastRequest = true;
+   }
+   conn->queued = false;
+   if( !conn->lastRequest ) {
+      network_watch( conn->fd, NETWORK_READ );       /* wait for more */
+   }
+   connection_settle( conn );
+   connection_release( conn );
+   pthread_mutex_unlock( &s->mutex );
+}
+
+
+bool serve_next( Shard * s, bool wait ) {
+   //Processes one readable connection of a shard, or else serves one turn
+   //of the next block in its ready queue. If wait is true and there is no
+   //work, the thread sleeps on the shard's condition until there is.
+   //Returns false if there was no work.
+
+   pthread_mutex_lock( &s->mutex );
+   while( wait && !s->workHead && readySize( s ) == 0 ) {
+      pthread_cond_wait( &s->condition, &s->mutex );
+   }
+
+   if( s->workHead ) {
+      // dequeue a connection and process its requests
+      Connection * conn = s->workHead;
+      s->workHead = conn->workNext;
+      if( !s->workHead ) {
+         s->workTail = NULL;
+      }
+      pthread_mutex_unlock( &s->mutex );
+
+      process_client(conn);
+   } else if( readySize( s ) > 0 ) {
+      // select the next request from the scheduler's ready queue
+      RequestControlBlock * b = sched_next( &s->ready );
+      if( !b->blocked ) {                            /* else resumed, and */
+         arm_send( b->conn, b );                     /* its deadline runs */
+      }
+      pthread_mutex_unlock( &s->mutex );
+
+      serve_client2(b);
+      if( !b->blocked && b->bytesRemaining == 0 ) {
+         trace_add( b );                             /* before the lock */
+      }
+
+      pthread_mutex_lock( &s->mutex );
+      if( b->blocked ) {
+         // the client's send buffer is full, so serve others until the
+         // client has taken some of it
+         park_block( b );
+      } else if( b->bytesRemaining > 0 ) {
+         // preempted, so the policy decides where it goes
+         wheel_remove( &s->timers, &b->conn->deadline );
+         sched_expired( &s->ready, b );
+         pthread_cond_signal( &s->condition );
+      } else {
+         wheel_remove( &s->timers, &b->conn->deadline );
+         complete_block(b);
+      }
+      pthread_mutex_unlock( &s->mutex );
+   } else {
+      pthread_mutex_unlock( &s->mutex );
+      return false;
+   }
+   return true;
+}
+
+
+void poll_shard( Shard * s, int timeout ) {
+   //Waits up to timeout milliseconds for network events of a shard, hands
+   //them to its connections, and acts on connections whose deadline has
+   //passed.
+
+   network_event events[64];                         // ready connections
+   int i, n;
+
+   n = network_poll( s->index, events, 64, timeout );
+
+   pthread_mutex_lock( &s->mutex );
+   expire_timers( s );                               /* before a trickle of */
+   for( i = 0; i < n; i++ )                          /* data cancels them */
    {
-      if (there are any requests in the work_queue)
-      {
-         dequeue a request and process it in the same manner as in Task 1.
+      if( events[i].flags & NETWORK_WAKE ) {
+         // the disk pool has opened files for the shard
+         finish_opens( s );
       }
-      else if (there are no requests in the work_queue and there are requests in the scheduler's ready queue to be processed)
-      {
-         Select the next request and process it in the same manner as in Task 1.
+      else if( events[i].flags & NETWORK_OPEN ) {
+         // under overload, or over its rate, a client gets a 503 at once
+         if( overloaded( s ) || !ratelimit_allow( events[i].fd ) ) {
+            refuse_connection( events[i].fd );
+         } else {
+            connection_open( s, events[i].fd );
+         }
       }
-      else
-      {
+      // a parked block goes back to the scheduler once its client has
+      // room in its send buffer
+      else if( events[i].flags & NETWORK_WRITE ) {
+         if( connections[events[i].fd] ) {
+            resume_block( connections[events[i].fd] );
+         }
+      }
+      // a client is handed to a worker thread once its request has
+      // arrived
+      else if( events[i].flags & ( NETWORK_READ | NETWORK_HUP ) ) {
+         if( connections[events[i].fd] ) {
+            enqueue_work( connections[events[i].fd] );
+         }
+      }
+   }
+   pthread_mutex_unlock( &s->mutex );
+}
+
 
-      // Since there are no requests in the work_queue or the scheduler, 
-      // the thread should suspend itself until it is awakened by the main thread
+void pin_cpu( int n ) {
+   //Pins the calling thread to the n'th of the CPUs it may run on, wrapping
+   //around if there are fewer CPUs than that.
 
-         pthread_mutex_lock(&mutex);
-         pthread_cond_wait(&condition, &mutex);
+   cpu_set_t allowed, one;
+   int cpu;
+
+   if( sched_getaffinity( 0, sizeof( allowed ), &allowed ) || CPU_COUNT( &allowed ) == 0 ) {
+      return;
+   }
+   n %= CPU_COUNT( &allowed );
+   for( cpu = 0; !CPU_ISSET( cpu, &allowed ) || n-- > 0; cpu++ );
+
+   CPU_ZERO( &one );
+   CPU_SET( cpu, &one );
+   pthread_setaffinity_np( pthread_self(), sizeof( one ), &one );
+}
+
+
+void * thread_routine( void * arg ) {
+   //Each worker thread drains the work queue first, then serves blocks from
+   //the scheduler's ready queue. When both are empty the thread sleeps on
+   //condition until the main thread accepts another connection.
+
+   Shard * s = arg;
+
+   for( ;; ) {
+      serve_next( s, true );
+   }
+   return NULL;
+}
+
+
+void * shard_routine( void * arg ) {
+   //With -s, each worker thread owns a shard and runs its event loop: it
+   //polls the shard's listener and connections, then serves up to a batch
+   //of turns before polling again. The poll only sleeps when the shard has
+   //no work left.
+
+   Shard * s = arg;
+   int i = 0;
+
+   pin_cpu( s->index );
+   for( ;; ) {
+      poll_shard( s, i == SHARD_BATCH ? 0 : 1000 );
+      for( i = 0; i < SHARD_BATCH && serve_next( s, false ); i++ );
+   }
+   return NULL;
+}
+
+
+int parse_limits( char * list ) {
+   //Parses the -Q option, a comma separated list with the most bytes that
+   //may be queued at each scheduler level from the highest priority down,
+   //0 meaning no limit.
+   //Returns 0 on success.
+
+   char * brk;                                       /* state used by strtok */
+   char * tok;                                       /* one limit */
+   int n = 0;
+
+   levelLimit = calloc( strlen( list ) / 2 + 1, sizeof( long ) );
+   for( tok = strtok_r( list, ",", &brk ); tok; tok = strtok_r( NULL, ",", &brk ) ) {
+      if( ( sscanf( tok, "%ld", &levelLimit[n] ) < 1 ) || ( levelLimit[n] < 0 ) ) {
+         return -1;
       }
+      n++;
    }
+   numLevelLimits = n;
+   return n > 0 ? 0 : -1;
 }
-*/
 
 
 /* This function is where the program starts running.
@@ -332,150 +1316,195 @@ void thread_routine()
 int main( int argc, char **argv ) {
 
    int port = -1;                                    // server port # 
-   int fd;                                           // client file descriptor 
-   char * schedulerType = malloc(sizeof(argv[2]) * sizeof(char));
-
-   int feedbackLevel = 0;        //for multilevel feedback queue
-   int qSize = 8192;                    // # of bytes to put in the queue
-
-   if (argc >= 3) {
-      strcpy(schedulerType, argv[2]);                   //scheduler type as argv
+   int numThreads = -1;                              // # of worker threads
+   int opt;                                          // option letter
+   long cacheSize = CACHE_SIZE;                      // content cache bytes
+   int openFiles = FILE_BUDGET;                      // open file cache size
+   char * traceFile = NULL;                          // where to trace to
+   double rate = 0, burst = 0;                       // -r accepts per second
+
+   // check for and process options, then parameters 
+
+   while( ( opt = getopt( argc, argv, "q:l:a:c:k:H:R:b:m:Q:r:t:i:f:su" ) ) != -1 ) {
+      switch( opt ) {
+      case 'q':                                      // RR and SRPT quantum
+         if( ( sscanf( optarg, "%d", &sched_quantum ) < 1 ) || ( sched_quantum < 1 ) ) {
+            printf( "Error: quantum must be a positive number of bytes\n" );
+            return 0;
+         }
+         break;
+      case 'l':                                      // MLFB level quanta
+         if( sched_parse_levels( optarg ) ) {
+            printf( "Error: levels must be a list of quanta, e.g. 8192,65536,0\n" );
+            return 0;
+         }
+         break;
+      case 'a':                                      // SRPT aging
+         if( ( sscanf( optarg, "%ld", &sched_aging ) < 1 ) || ( sched_aging < 0 ) ) {
+            printf( "Error: aging must be a number of bytes per second\n" );
+            return 0;
+         }
+         break;
+      case 'c':                                      // content cache size
+         if( ( sscanf( optarg, "%ld", &cacheSize ) < 1 ) || ( cacheSize < 0 ) ) {
+            printf( "Error: cache size must be a number of bytes\n" );
+            return 0;
+         }
+         break;
+      case 'k':                                      // keep-alive timeout
+         if( ( sscanf( optarg, "%d", &keepAliveTimeout ) < 1 ) || ( keepAliveTimeout < 0 ) ) {
+            printf( "Error: keep-alive timeout must be a number of seconds\n" );
+            return 0;
+         }
+         break;
+      case 'H':                                      // request timeout
+         if( ( sscanf( optarg, "%d", &headerTimeout ) < 1 ) || ( headerTimeout < 0 ) ) {
+            printf( "Error: header timeout must be a number of seconds\n" );
+            return 0;
+         }
+         break;
+      case 'R':                                      // min transfer rate
+         if( ( sscanf( optarg, "%d", &minRate ) < 1 ) || ( minRate < 0 ) ) {
+            printf( "Error: min rate must be a number of bytes per second\n" );
+            return 0;
+         }
+         break;
+      case 'b':                                      // listen backlog
+         if( ( sscanf( optarg, "%d", &backlog ) < 1 ) || ( backlog < 1 ) ) {
+            printf( "Error: backlog must be a positive number of connections\n" );
+            return 0;
+         }
+         break;
+      case 'm':                                      // max requests
+         if( ( sscanf( optarg, "%d", &maxRequests ) < 1 ) || ( maxRequests < 0 ) ) {
+            printf( "Error: max requests must be a number of requests\n" );
+            return 0;
+         }
+         break;
+      case 'Q':                                      // max queued bytes
+         if( parse_limits( optarg ) ) {
+            printf( "Error: limits must be a list of bytes per level, e.g. 1048576,67108864\n" );
+            return 0;
+         }
+         break;
+      case 'r':                                      // accept rate per IP
+         if( ( sscanf( optarg, "%lf,%lf", &rate, &burst ) < 1 ) || ( rate <= 0 ) ) {
+            printf( "Error: rate must be a number of connections per second\n" );
+            return 0;
+         }
+         break;
+      case 't':                                      // request trace
+         traceFile = optarg;
+         break;
+      case 'i':                                      // disk pool size
+         if( ( sscanf( optarg, "%d", &diskThreads ) < 1 ) || ( diskThreads < 0 ) ) {
+            printf( "Error: disk threads must be a number of threads\n" );
+            return 0;
+         }
+         break;
+      case 'f':                                      // open file cache size
+         if( ( sscanf( optarg, "%d", &openFiles ) < 1 ) || ( openFiles < 0 ) ) {
+            printf( "Error: open files must be a number of files\n" );
+            return 0;
+         }
+         break;
+      case 's':                                      // shard per worker
+         sharded = true;
+         break;
+      case 'u':                                      // io_uring backend
+         uring = true;
+         break;
+      default:
+         printf( USAGE );
+         return 0;
+      }
    }
+   argc -= optind - 1;                               // parameters follow the
+   argv += optind - 1;                               // options in argv[1..]
 
-   // check for and process parameters 
-
-   if( ( argc < 3 ) || ( sscanf( argv[1], "%d", &port ) < 1 ) ) {
-      printf( "usage: sws <port> <scheduler>\n" );
+   if( ( argc < 4 ) || ( sscanf( argv[1], "%d", &port ) < 1 ) 
+         || ( sscanf( argv[3], "%d", &numThreads ) < 1 ) || ( numThreads < 1 ) ) {
+      printf( USAGE );
       return 0;
    }
-   else if (argc > 3)
+   else if (argc > 4)
    {
       //This code exists for verbose error checking at runtime
       printf("WARNING: Extra arguments encountered:\n");
       int i; 
-      for (i = 3; i < argc; i++)
+      for (i = 4; i < argc; i++)
       {
          printf("argv[%d]: %s\n", i, argv[i]);  
       }
    }
 
-   if (strcmp(schedulerType, "RR")== 0 ){
-      // do round robin code
-      printf("Round Robin scheduler selected\n");
-      rr = true;
+   policy = sched_find( argv[2] );                   //scheduler type as argv
+   if( !policy ) {
+      printf("Error: unknown scheduler selected.\n");
+      printf("Please select one of 'RR', 'SJF', 'MLFB' or 'SRPT'\n");
+      abort();
    }
-   else if (strcmp(schedulerType, "SJF") == 0)
-   {
-      // do shortest job first code
-      printf("Shortest Job First scheduler selected\n");
-      sjf = true;
+   printf("%s scheduler selected\n", policy->title);
+
+   struct rlimit nofile;                             // max open files
+   getrlimit( RLIMIT_NOFILE, &nofile );
+   maxConnections = nofile.rlim_cur;
+   connections = calloc( maxConnections, sizeof( Connection * ) );
+
+   fdcache_init( openFiles );                        // init open file cache
+   cache_init( cacheSize, CACHE_MAX_OBJECT );        // init content cache
+   gzip_init( GZIP_SIZE, GZIP_MAX_OBJECT );          // init gzip cache
+   stats_init( policy->name );                       // init statistics
+   if( rate > 0 ) {
+      ratelimit_init( rate, burst > 0 ? burst : rate );  // burst of 1 second
    }
-   else if (strcmp(schedulerType, "MLFB") == 0)
-   {
-      // do mulitlevel feedback queue
-      printf("Multilevel Feedback Queue scheduler selected\n");
-      mlfb = true;
+   if( traceFile && trace_open( traceFile, TRACE_RECORDS, policy->name ) ) {
+      perror( "Error while creating the trace" );
+      return 0;
    }
-   else 
-   {
-      printf("Error: unknown scheduler selected.\n");
-      printf("Please select one of 'RR', 'SJF', or 'MLFB'\n"); 
-      abort();
+
+   // one shard for all workers, or one per worker
+   int i, rc;
+   numShards = sharded ? numThreads : 1;
+   shards = calloc( numShards, sizeof( Shard ) );
+   for( i = 0; i < numShards; i++ ) {
+      shards[i].index = i;
+      pthread_mutex_init( &shards[i].mutex, NULL );
+      pthread_cond_init( &shards[i].condition, NULL );
+      sched_init( &shards[i].ready, policy );
+      wheel_init( &shards[i].timers, now_ms(), TIMER_TICK );
    }
 
-   RequestControlBlock table[64];
-   network_init( port );                             // init network module 
+   if( uring && !network_use_uring() ) {
+      printf( "io_uring is not supported, using epoll\n" );
+   }
+   network_init_shards( port, numShards, backlog );  // init network module 
+   if( diskThreads > 0 && disk_init( diskThreads, numShards ) ) {
+      diskThreads = 0;                               // open files inline
+   }
 
-   // MULTITHREADING PROTOTYPE
-   /*
-      int rc;
-      pthread_t threads[argv[3]];
-      for (int i = 0; i < argv[3]; ++i)
-      {
-      rc = pthread_create(&threads[i], NULL, thread_routine, NULL);
+   // start the worker threads
+   pthread_t * threads = malloc( numThreads * sizeof( pthread_t ) );
+   for (i = 0; i < numThreads; ++i)
+   {
+      if (sharded){
+         rc = pthread_create(&threads[i], NULL, shard_routine, &shards[i]);
+      } else {
+         rc = pthread_create(&threads[i], NULL, thread_routine, &shards[0]);
+      }
       if (rc != 0)
       {
-      printf("Error: pthread_create() returned: %d\n", rc);
-      abort();
-      }
+         printf("Error: pthread_create() returned: %d\n", rc);
+         abort();
       }
-
-*/
-   network_wait();    //call once before starting loop and again at end of loop
+   }
 
    for( ;; ) {                                       // main loop 
-
-      for( fd = network_open(); fd >= 0; fd = network_open() ) // get control blocks 
-      {
-
-
-
-         RequestControlBlock b;
-         b.fileDescriptor = fd;
-         
-         //pthread_cond_signal(&condition);
-
-         b = process_client(b);
-
-         // check if block exists, add to table if false
-         if (!blockExists(b, table)){
-            table[seqCounter-1] = b;
-            seqCounter++;
-         }
-
-         //Do SJF scheduling
-         //The request control blocks are reordered in the table to place the
-         // shortest jobs first 
-         if (sjf && !rr && !mlfb){
-            //looping variables for SJF
-            int k, j;
-            int n = seqCounter-1;
-            RequestControlBlock temp;
-
-            for (k = 0; k < n; k++){
-               for (j = k; j<n; j++){
-                  if (table[j].bytesRemaining < table[k].bytesRemaining ){
-                     temp = table[k];
-                     table[k]=table[j];
-                     table[j] = temp;
-                  }
-               }
-            }
-         }
-         // Do RR sscheduling 
-         else if (rr && !sjf && !mlfb){
-            // No logic is done here for RR scheduling, instead an if statement is added
-            // to serve_client to break out of the do_while loop
-         }
-         // Do multilevel feedback queue
-         else if (mlfb && !sjf && !rr) {
-            if (feedbackLevel == 1)
-               qSize = 65536;                   // for the second feedback queue size
-            else if (feedbackLevel > 1)
-               qSize = -1;                      // negative integer to send all remaining bytes
-         }
-         else {
-            printf("Error, no scheduler selected\n");
-            abort();
-         }
-
-         int i;
-         for (int i = 0; i < seqCounter; i++)
-         {
-            // Process all the blocks that are waiting in the control table
-            table[i] = serve_client2(table[i]);
-         }
-
-         printrcb(table);
-
-         //table[filesServed].fileDescriptor=fd;
-         //table[filesServed] = serve_client2(table[filesServed]);
+      if( sharded ) {
+         pthread_join( threads[0], NULL );           // workers do the polling
+      } else {
+         poll_shard( &shards[0], 1000 );             // wait for clients
       }
-
-      feedbackLevel++; //increment feedback level to change queue size
-
-
-      network_wait();
    }
 
 }
@@ -0,0 +1,57 @@
+/* 
+ * File: sws.h
+ * Purpose: This file contains the request control block, which holds the
+ *          state of each client request, shared by the web server and its
+ *          scheduling queues.
+ */
+
+#ifndef SWS_H
+#define SWS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct RequestControlBlock{
+   // This is the request control table to store state info for each request by
+   // the client.
+   // It should be initialized as an array of RequestControlTables and
+   // should associate a spot in the array with a request from the client
+
+   int sequenceNumber;  //similar to process ID. sequence numbers start at 1
+   int fileDescriptor;  //returned by network_wait() in network.h
+   struct Connection * conn;     //client connection the request arrived on
+   int status;          //HTTP status code of the response
+   bool keepAlive;      //true if the connection stays open after the response
+   struct cache_entry * cached;  //body of the file if it is in the cache
+   struct transfer_reader * transfer;  //reader of the file if it is not
+   struct gzip_entry * gzipped;  //gzipped copy sent instead of the file
+   struct fdcache_entry * file;  //open file of a response without a body,
+                                 //e.g. a 304, for its headers
+   char * body;         //body generated by the server, e.g. the stats page
+   off_t offset;        //offset of the next byte of the file to send
+   bool headerSent;     //true once the response header has been sent
+   int headerOffset;    //bytes of the header sent while headerSent is false
+   off_t bytesRemaining;  //the number of bytes remaining to be sent
+   off_t size;          //the number of bytes of the body, for the trace
+   int quantum;         //max number of bytes to send
+   int turnSent;        //bytes of the quantum sent before the client's send
+                        //buffer filled, 0 at the start of a turn
+   bool blocked;        //the last turn stopped on a full send buffer
+   bool opening;        //the disk pool is opening its file
+   bool deferred;       //it was due in the scheduler while opening
+   bool dropped;        //its connection gave up on it while opening
+   int level;           //MLFB level, 0 being the highest priority
+   int64_t priority;    //heap order of SJF and SRPT, lowest first
+
+   uint64_t arrived;    //when the request arrived, from stats_now()
+   uint64_t parsed;     //when the request was parsed
+   uint64_t firstByte;  //when the first byte of the response was sent
+   uint64_t lastByte;   //when the last byte of the response was sent
+
+   char fname[100];        // req name of file
+
+}RequestControlBlock; 
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * File: trace.c
+ * Purpose: This file contains the request trace.
+ *          Please see trace.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "trace.h"
+#include "stats.h"
+
+#define SEEN_PATHS 65536                    /* paths remembered as written */
+
+static trace_file *file = NULL;             /* mapped header, NULL if off */
+static trace_record *ring;                  /* slots after the header */
+static FILE *paths;                         /* the .paths file */
+static uint64_t seen[SEEN_PATHS];           /* hashes of paths written */
+
+typedef struct trace_path {
+  uint64_t hash;                            /* hash of the path */
+  char *path;                               /* the path */
+  struct trace_path *next;
+} trace_path;
+
+static pthread_mutex_t paths_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t paths_queued = PTHREAD_COND_INITIALIZER;
+static trace_path *pending = NULL;          /* paths to write, newest first */
+
+
+extern uint64_t trace_hash( const char *path ) {
+  uint64_t h = 14695981039346656037ull;
+
+  if( !*path ) {
+    return 0;
+  }
+  for( ; *path; path++ ) {
+    h = ( h ^ (unsigned char)*path ) * 1099511628211ull;
+  }
+  return h ? h : 1;
+}
+
+
+/* This function queues a path for the .paths file the first time it is
+ *    seen.  The set of paths seen is an open addressing table of hashes
+ *    updated with compare and swap, so a path already written costs a few
+ *    loads.  Once the table is full a path may be written again, which
+ *    sws-replay does not mind.
+ * Parameters:
+ *             h    : the hash of the path
+ *             path : the path
+ * Returns: None
+ */
+static void remember( uint64_t h, const char *path ) {
+  trace_path *p;
+  uint64_t empty;
+  int i;
+  int n;
+
+  for( i = h % SEEN_PATHS, n = 0; n < SEEN_PATHS; i = ( i + 1 ) % SEEN_PATHS, n++ ) {
+    empty = 0;
+    if( __atomic_load_n( &seen[i], __ATOMIC_RELAXED ) == h ) {
+      return;                                           /* already written */
+    }
+    if( __atomic_compare_exchange_n( &seen[i], &empty, h, 0, __ATOMIC_RELAXED,
+                                     __ATOMIC_RELAXED ) ) {
+      break;                                            /* first sighting */
+    }
+    if( empty == h ) {
+      return;                                           /* another thread won */
+    }
+  }
+
+  p = malloc( sizeof( trace_path ) );
+  if( !p || !( p->path = strdup( path ) ) ) {
+    perror( "Error while allocating memory" );
+    abort();
+  }
+  p->hash = h;
+  pthread_mutex_lock( &paths_lock );
+  p->next = pending;
+  pending = p;
+  pthread_cond_signal( &paths_queued );
+  pthread_mutex_unlock( &paths_lock );
+}
+
+
+/* This function is the main loop of the thread that appends the paths
+ *    queued by remember() to the .paths file, so no request waits for it.
+ */
+static void *writer( void *arg ) {
+  trace_path *p, *next, *order;
+
+  for( ;; ) {
+    pthread_mutex_lock( &paths_lock );
+    while( !pending ) {
+      pthread_cond_wait( &paths_queued, &paths_lock );
+    }
+    p = pending;
+    pending = NULL;
+    pthread_mutex_unlock( &paths_lock );
+
+    for( order = NULL; p; p = next ) {                  /* oldest first */
+      next = p->next;
+      p->next = order;
+      order = p;
+    }
+    for( p = order; p; p = next ) {
+      next = p->next;
+      fprintf( paths, "%016llx %s\n", (unsigned long long)p->hash, p->path );
+      free( p->path );
+      free( p );
+    }
+    fflush( paths );
+  }
+  return NULL;
+}
+
+
+extern int trace_open( const char *path, long records, const char *scheduler ) {
+  char name[1024];
+  struct timespec wall;
+  pthread_t thread;
+  size_t length = sizeof( trace_file ) + records * sizeof( trace_record );
+  int fd;
+
+  snprintf( name, sizeof( name ), "%s.paths", path );
+  fd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+  if( ( fd < 0 ) || ( records < 1 ) || ftruncate( fd, length ) ) {
+    if( fd >= 0 ) {
+      close( fd );
+    }
+    return -1;
+  }
+  file = mmap( NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0 );
+  close( fd );                                          /* the mapping stays */
+  paths = fopen( name, "w" );
+  if( ( file == MAP_FAILED ) || !paths
+      || pthread_create( &thread, NULL, writer, NULL ) ) {
+    file = NULL;
+    return -1;
+  }
+
+  clock_gettime( CLOCK_REALTIME, &wall );
+  memcpy( file->magic, TRACE_MAGIC, sizeof( file->magic ) );
+  file->version = TRACE_VERSION;
+  file->record_size = sizeof( trace_record );
+  file->capacity = records;
+  file->head = 0;
+  file->started = stats_now();
+  file->wall = wall.tv_sec * 1000000000ull + wall.tv_nsec;
+  snprintf( file->scheduler, sizeof( file->scheduler ), "%s", scheduler );
+  ring = (trace_record *)( file + 1 );
+  return 0;
+}
+
+
+extern void trace_add( RequestControlBlock *b ) {
+  trace_record *r;
+  uint64_t n;
+
+  if( !file ) {
+    return;
+  }
+
+  n = __atomic_fetch_add( &file->head, 1, __ATOMIC_RELAXED );
+  r = &ring[n % file->capacity];
+  __atomic_store_n( &r->seq, 0, __ATOMIC_RELAXED );    /* torn until done */
+  __atomic_thread_fence( __ATOMIC_RELEASE );
+  r->arrived = b->arrived;
+  r->first_byte = b->firstByte;
+  r->completed = b->lastByte;
+  r->path = trace_hash( b->fname );
+  r->size = b->size;
+  r->sent = b->size - b->bytesRemaining;
+  r->level = b->level;
+  r->status = b->status;
+  __atomic_store_n( &r->seq, n + 1, __ATOMIC_RELEASE );
+
+  if( r->path ) {
+    remember( r->path, b->fname );
+  }
+}
@@ -0,0 +1,94 @@
+/*
+ * File: trace.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          request trace, a binary record of every request served, and the
+ *          layout of the trace file, which is shared with sws-replay.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include "sws.h"
+
+/*
+ * This module has three functions:
+ *   trace_open() : start tracing to a file
+ *   trace_add()  : add a completed request to the trace
+ *   trace_hash() : hash a path as the trace records it
+ *
+ * The trace file is a trace_file header followed by a ring of fixed size
+ * trace_record slots, and is mapped into memory, so adding a record is an
+ * atomic add and a 64 byte copy with no system call.  The kernel writes the
+ * pages back in the background, and the file is complete as soon as the
+ * server stops, even if it is killed.  When the ring is full the oldest
+ * records are overwritten; head counts every record ever added, so the ring
+ * holds records head - capacity to head - 1.  A slot's seq is written last,
+ * and is one more than the record's number once the record is complete.
+ *
+ * Paths are recorded as a 64 bit FNV-1a hash.  The first time a path is
+ * seen, it is queued for a thread that appends a "hash path" line to a text
+ * file named after the trace with ".paths" added, so a trace can be
+ * replayed against the same files.
+ * A request that named no file, e.g. a 404, has the hash 0.
+ *
+ * Times are from stats_now(), in nanoseconds of the monotonic clock.
+ */
+
+#define TRACE_MAGIC "SWSTRACE"          /* first bytes of a trace file */
+#define TRACE_VERSION 1                 /* layout of the records */
+
+typedef struct trace_file {
+  char magic[8];                        /* TRACE_MAGIC */
+  uint32_t version;                     /* TRACE_VERSION */
+  uint32_t record_size;                 /* sizeof( trace_record ) */
+  uint64_t capacity;                    /* slots in the ring */
+  uint64_t head;                        /* number of records ever added */
+  uint64_t started;                     /* stats_now() when the trace began */
+  uint64_t wall;                        /* and the wall clock, in ns */
+  char scheduler[16];                   /* name of the scheduler */
+} trace_file;
+
+typedef struct trace_record {
+  uint64_t seq;                         /* record number + 1, 0 if torn */
+  uint64_t arrived;                     /* when the request arrived */
+  uint64_t first_byte;                  /* when its first byte was sent */
+  uint64_t completed;                   /* when its last byte was sent */
+  uint64_t path;                        /* hash of the path, 0 if none */
+  int64_t size;                         /* bytes of the body to send */
+  int64_t sent;                         /* bytes of the body sent */
+  int32_t level;                        /* MLFB level when it completed */
+  int32_t status;                       /* HTTP status of the response */
+} trace_record;
+
+
+/* This function creates a trace file and starts tracing to it.  It should
+ *    be called at most once, before any call to trace_add().
+ * Parameters:
+ *             path      : the name of the trace file, which is replaced
+ *             records   : the number of records the ring holds
+ *             scheduler : the name of the scheduler, for the header
+ * Returns: 0 on success, -1 if the file could not be created.
+ */
+extern int trace_open( const char *path, long records, const char *scheduler );
+
+
+/* This function adds a completed request to the trace.  It does nothing if
+ *    trace_open() has not been called.  It is thread safe and never waits
+ *    for the disk.
+ * Parameters:
+ *             b : the request, after its last byte has been sent
+ * Returns: None
+ */
+extern void trace_add( RequestControlBlock *b );
+
+
+/* This function returns the hash a path is recorded under.
+ * Parameters:
+ *             path : the normalized path
+ * Returns: The hash, which is never 0 for a non-empty path.
+ */
+extern uint64_t trace_hash( const char *path );
+
+#endif
@@ -0,0 +1,367 @@
+/*
+ * File: transfer.c
+ * Purpose: This file contains the shared file transfers.
+ *          Please see transfer.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "transfer.h"
+#include "network.h"
+#include "pool.h"
+#include "lru.h"
+
+#define BUCKETS 256                         /* hash table size */
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static transfer *table[BUCKETS];            /* transfers that can be joined */
+static slab readers = SLAB_INITIALIZER( sizeof( transfer_reader ), 64 );
+
+
+/* This function frees the chunks that no reader needs any more.  They are
+ *    usually at the head, but a dropped reader may hold on to a chunk that
+ *    every other reader is past.  The transfer's lock must be held.
+ */
+static void trim( transfer *t ) {
+  transfer_chunk *prev = NULL;
+  transfer_chunk *c;
+  transfer_chunk *next;
+
+  for( c = t->head; c; c = next ) {
+    next = c->next;
+    if( c->refs > 0 ) {
+      prev = c;
+      continue;
+    }
+    if( prev ) {
+      prev->next = next;
+    } else {
+      t->head = next;
+    }
+    if( t->tail == c ) {
+      t->tail = prev;
+    }
+    t->whole = 0;                                       /* start is gone */
+    free( c );
+  }
+}
+
+
+/* This function removes a transfer from the hash table, so no more readers
+ *    join it.  The table's lock must be held.
+ */
+static void unlist( transfer *t ) {
+  transfer **p;
+
+  if( !t->listed ) {
+    return;
+  }
+  for( p = &table[lru_hash( t->path ) % BUCKETS]; *p != t; p = &( *p )->hnext );
+  *p = t->hnext;
+  t->listed = 0;
+}
+
+
+/* This function puts a reader on the stream of a transfer.  The transfer's
+ *    lock must be held.
+ */
+static void share( transfer *t, transfer_reader *r ) {
+  r->prev = NULL;
+  r->next = t->stream;
+  if( t->stream ) {
+    t->stream->prev = r;
+  }
+  t->stream = r;
+  t->readers++;
+  r->shared = 1;
+}
+
+
+/* This function takes a reader off the stream of a transfer and drops its
+ *    references to the chunks it has not sent.  The transfer's lock must be
+ *    held.
+ * Parameters:
+ *             t    : the transfer
+ *             r    : the reader
+ *             keep : 1 if the reader may be sending from the chunk holding
+ *                    its offset, in which case it keeps that chunk as its
+ *                    pin until it is done with it
+ * Returns: None
+ */
+static void unshare( transfer *t, transfer_reader *r, int keep ) {
+  transfer_chunk *c;
+
+  for( c = t->head; c; c = c->next ) {
+    if( c->offset + c->len <= r->offset ) {
+      continue;                                         /* already sent */
+    }
+    if( keep && ( c->offset <= r->offset ) ) {
+      r->pin = c;
+    } else {
+      c->refs--;
+    }
+  }
+  if( r->prev ) {
+    r->prev->next = r->next;
+  } else {
+    t->stream = r->next;
+  }
+  if( r->next ) {
+    r->next->prev = r->prev;
+  }
+  t->readers--;
+  r->shared = 0;
+  trim( t );
+}
+
+
+/* This function gets the chunk holding a byte of the file, reading it from
+ *    the disk if no reader has got to it yet.  The transfer's lock must be
+ *    held.  It is let go during the read, so other readers can go on
+ *    sending the chunks they have, but readers that want the chunk being
+ *    read wait for it instead of reading it again.  Before a chunk is read,
+ *    the readers more than TRANSFER_WINDOW bytes behind it are dropped.
+ * Parameters:
+ *             t      : the transfer
+ *             offset : the offset of the byte
+ * Returns: The chunk, or NULL if the byte is past the end of the file or
+ *          the read failed.
+ */
+static transfer_chunk *chunk_at( transfer *t, off_t offset ) {
+  transfer_chunk *c;
+  transfer_reader *r;
+  transfer_reader *next;
+  off_t at;
+  ssize_t n;
+  int got;
+
+  while( t->reading && ( offset >= t->next ) ) {        /* being read */
+    pthread_cond_wait( &t->read, &t->lock );
+  }
+  for( c = t->head; c; c = c->next ) {
+    if( offset < c->offset + c->len ) {
+      return offset >= c->offset ? c : NULL;
+    }
+  }
+  if( offset != t->next || t->next >= t->size ) {
+    return NULL;                                        /* reader is lost */
+  }
+
+  for( r = t->stream; r; r = next ) {                   /* drop stragglers */
+    next = r->next;
+    if( r->offset + TRANSFER_WINDOW <= t->next ) {
+      unshare( t, r, 1 );
+    }
+  }
+
+  c = malloc( sizeof( transfer_chunk ) + TRANSFER_CHUNK );
+  if( !c ) {
+    perror( "Error while allocating memory" );
+    abort();
+  }
+  c->data = (char *)( c + 1 );
+  at = t->next;
+  t->reading = 1;
+  pthread_mutex_unlock( &t->lock );
+  for( got = 0; got < TRANSFER_CHUNK && at + got < t->size; got += n ) {
+    n = pread( t->fd, c->data + got, TRANSFER_CHUNK - got, at + got );
+    if( n <= 0 ) {                                      /* file shrank */
+      break;
+    }
+  }
+  pthread_mutex_lock( &t->lock );
+  t->reading = 0;
+  pthread_cond_broadcast( &t->read );
+  if( got == 0 ) {
+    free( c );
+    return NULL;
+  }
+
+  c->next = NULL;
+  c->offset = at;
+  c->len = got;
+  c->refs = t->readers;                                 /* none are past it */
+  t->next += got;
+  if( t->tail ) {
+    t->tail->next = c;
+  } else {
+    t->head = c;
+  }
+  t->tail = c;
+  return c;
+}
+
+
+extern transfer_reader *transfer_join( const char *path, fdcache_entry *file,
+                                       off_t from ) {
+  struct stat *st = &file->st;
+  transfer_reader *r = slab_alloc( &readers );
+  transfer *t;
+  transfer_chunk *c;
+  unsigned int b = lru_hash( path ) % BUCKETS;
+
+  memset( r, 0, sizeof( transfer_reader ) );
+  r->offset = from;
+
+  pthread_mutex_lock( &lock );
+  for( t = from ? NULL : table[b]; t; t = t->hnext ) {
+    if( !strcmp( t->path, path ) ) {
+      break;
+    }
+  }
+  if( t && ( t->size != st->st_size
+             || t->mtime.tv_sec != st->st_mtim.tv_sec
+             || t->mtime.tv_nsec != st->st_mtim.tv_nsec ) ) {
+    unlist( t );                                        /* file has changed */
+    t = NULL;
+  }
+
+  if( t ) {
+    pthread_mutex_lock( &t->lock );
+    t->users++;
+    if( t->whole ) {
+      for( c = t->head; c; c = c->next ) {              /* the stream holds */
+        c->refs++;                                      /* the start, so */
+      }                                                 /* start at 0 */
+      share( t, r );
+    }
+    pthread_mutex_unlock( &t->lock );
+    pthread_mutex_unlock( &lock );
+    fdcache_release( file );
+    r->t = t;
+    return r;
+  }
+
+  t = malloc( sizeof( transfer ) );
+  if( !t ) {
+    perror( "Out of memory" );
+    abort();
+  }
+  memset( t, 0, sizeof( transfer ) );
+  t->path = strdup( path );
+  t->file = file;
+  t->fd = file->fd;
+  t->size = st->st_size;
+  t->mtime = st->st_mtim;
+  t->header = file->header;
+  t->users = 1;
+  t->whole = 1;
+  t->next = from;
+  pthread_mutex_init( &t->lock, NULL );
+  pthread_cond_init( &t->read, NULL );
+  if( from == 0 ) {                                     /* others may join */
+    share( t, r );
+    t->listed = 1;
+    t->hnext = table[b];
+    table[b] = t;
+  }
+  pthread_mutex_unlock( &lock );
+  r->t = t;
+  return r;
+}
+
+
+extern int transfer_send( transfer_reader *r, int fd, off_t *offset, int count ) {
+  transfer *t;
+  transfer_chunk *c;
+  struct iovec iov;                                     /* rest of chunk */
+  int sent = 0;
+  int shared;                                           /* reads the stream */
+  int len;                                              /* bytes of chunk */
+  int n;
+
+  while( sent < count ) {
+    t = r->t;
+    pthread_mutex_lock( &t->lock );
+    if( r->pin ) {                                      /* was dropped */
+      r->pin->refs--;
+      r->pin = NULL;
+      trim( t );
+    }
+    if( r->shared && ( t->readers == 1 ) ) {            /* nobody to share */
+      unshare( t, r, 0 );                               /* with any more */
+    }
+    shared = r->shared;
+    c = shared ? chunk_at( t, *offset ) : NULL;
+    pthread_mutex_unlock( &t->lock );
+
+    if( !shared ) {                                     /* on its own */
+      n = network_sendfile( fd, t->fd, offset, count - sent );
+      return n < 0 ? -1 : sent + n;
+    }
+    if( !c ) {
+      errno = EIO;                                      /* file ended early */
+      break;
+    }
+
+    len = c->offset + c->len - *offset;                 /* we hold a ref, */
+    if( len > count - sent ) {                          /* so c stays put */
+      len = count - sent;
+    }
+    iov.iov_base = c->data + ( *offset - c->offset );
+    iov.iov_len = len;
+    n = network_sendv( fd, &iov, 1 );                   /* what fits */
+    if( n < 0 ) {
+      return -1;
+    }
+    *offset += n;
+    sent += n;
+
+    pthread_mutex_lock( &t->lock );
+    if( *offset == c->offset + c->len ) {               /* done with chunk, */
+      if( r->pin == c ) {                               /* even if dropped */
+        r->pin = NULL;                                  /* while sending it */
+      }
+      c->refs--;
+      trim( t );
+    }
+    if( r->shared ) {
+      r->offset = *offset;
+    }
+    pthread_mutex_unlock( &t->lock );
+    if( n < len ) {
+      break;
+    }
+  }
+  return sent;
+}
+
+
+extern void transfer_leave( transfer_reader *r ) {
+  transfer *t = r->t;
+  transfer_chunk *c;
+
+  pthread_mutex_lock( &lock );
+  pthread_mutex_lock( &t->lock );
+  if( r->pin ) {
+    r->pin->refs--;
+  }
+  if( r->shared ) {
+    unshare( t, r, 0 );
+  }
+  trim( t );
+  slab_free( &readers, r );
+  t->users--;
+  if( t->users > 0 ) {
+    pthread_mutex_unlock( &t->lock );
+    pthread_mutex_unlock( &lock );
+    return;
+  }
+
+  unlist( t );                                          /* last reader */
+  pthread_mutex_unlock( &lock );
+  while( ( c = t->head ) ) {
+    t->head = c->next;
+    free( c );
+  }
+  pthread_mutex_unlock( &t->lock );
+  pthread_mutex_destroy( &t->lock );
+  pthread_cond_destroy( &t->read );
+  fdcache_release( t->file );
+  free( t->path );
+  free( t );
+}
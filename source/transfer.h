@@ -0,0 +1,127 @@
+/*
+ * File: transfer.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          transfer module, which lets concurrent requests for the same
+ *          large file share one stream of reads from the disk.
+ */
+
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "header.h"
+#include "fdcache.h"
+
+/*
+ * This module has three functions:
+ *   transfer_join()  : join or start the transfer of a file
+ *   transfer_send()  : send the next part of the file to a client
+ *   transfer_leave() : stop reading a transfer
+ *
+ * A request sends its file through a reader of the file's transfer.  A
+ * reader on its own sends the file with network_sendfile(), so the data
+ * never passes through user space.  When several requests for a file start
+ * together, e.g. when it goes viral, their readers share one stream of
+ * reads instead: the file is read in chunks of TRANSFER_CHUNK bytes, each
+ * read from the disk once, by the first reader to get to it, and every
+ * reader sends the chunks to its own client at its own pace.  A chunk holds
+ * a reference for each reader that has not sent it yet, and is freed once
+ * the slowest reader is past it.
+ *
+ * A new request joins the shared stream while the stream still holds the
+ * start of the file.  Requests that come later, and requests for a range
+ * that starts past the beginning of the file, read on their own.  The
+ * fastest reader never reads more than TRANSFER_WINDOW bytes ahead of the
+ * slowest: a reader that falls further behind is dropped from the stream,
+ * and so is a reader left alone on it, and goes on with sendfile, so a
+ * transfer holds at most TRANSFER_WINDOW bytes of chunks.  The module is
+ * thread safe.
+ */
+
+#define TRANSFER_CHUNK ( 64 << 10 )     /* bytes read from the disk at once */
+#define TRANSFER_WINDOW ( 8 << 20 )     /* most bytes between the readers */
+
+typedef struct transfer_chunk {
+  struct transfer_chunk *next;          /* chunk after this one */
+  off_t offset;                         /* offset of data in the file */
+  int len;                              /* bytes of data */
+  int refs;                             /* readers that have not sent it */
+  char *data;                           /* TRANSFER_CHUNK bytes */
+} transfer_chunk;
+
+typedef struct transfer_reader {
+  struct transfer *t;                   /* the transfer it reads */
+  struct transfer_reader *next;         /* next reader of the stream */
+  struct transfer_reader *prev;
+  off_t offset;                         /* next byte it sends, if shared */
+  int shared;                           /* 1 while it reads the stream */
+  transfer_chunk *pin;                  /* chunk it held when dropped */
+} transfer_reader;
+
+typedef struct transfer {
+  char *path;                           /* normalized path of the file */
+  fdcache_entry *file;                  /* the open file */
+  int fd;                               /* its descriptor */
+  off_t size;                           /* size of the file */
+  struct timespec mtime;                /* modification time of the file */
+  file_header header;                   /* response headers of the file */
+  int users;                            /* readers of the transfer */
+  int readers;                          /* readers of the stream */
+  transfer_reader *stream;              /* those readers */
+  int listed;                           /* 1 while new readers may join */
+  int reading;                          /* 1 while a chunk is being read */
+  int whole;                            /* 1 while no chunk has been freed */
+  off_t next;                           /* offset of the next chunk to read */
+  transfer_chunk *head;                 /* chunks in memory, oldest first */
+  transfer_chunk *tail;
+  pthread_mutex_t lock;                 /* guards the readers and chunks */
+  pthread_cond_t read;                  /* signalled when a chunk is read */
+  struct transfer *hnext;               /* next transfer in hash chain */
+} transfer;
+
+
+/* This function joins the in-flight transfer of a file if there is one,
+ *    or else starts a new one.
+ * Parameters:
+ *             path : the normalized path of the file
+ *             file : the open file, which is released if a transfer is
+ *                    joined, or else owned by the new transfer; its status
+ *                    is checked so a request never joins the transfer of an
+ *                    older version of the file
+ *             from : the offset of the first byte the request wants
+ * Returns: The request's reader, which must be passed to transfer_leave()
+ *          once the request is done with it.
+ */
+extern transfer_reader *transfer_join( const char *path, fdcache_entry *file,
+                                       off_t from );
+
+
+/* This function sends part of a transfer to a client without waiting for
+ *    it, from the shared chunks, which it reads from the disk as needed, or
+ *    with sendfile if the reader is on its own.
+ * Parameters:
+ *             r      : the reader
+ *             fd     : the client connection
+ *             offset : pointer to the offset of the first byte to send; it
+ *                      is advanced by the number of bytes sent
+ *             count  : the number of bytes to send
+ * Returns: The number of bytes sent, which is less than count if the file
+ *          ended early, or if the client's send buffer filled, in which
+ *          case errno is EAGAIN, or -1 if an error occurred.
+ */
+extern int transfer_send( transfer_reader *r, int fd, off_t *offset, int count );
+
+
+/* This function removes a reader from its transfer.  The chunks the reader
+ *    has not sent are released, and the transfer is freed once it has no
+ *    readers left.
+ * Parameters:
+ *             r : the reader, which is freed
+ * Returns: None
+ */
+extern void transfer_leave( transfer_reader *r );
+
+#endif
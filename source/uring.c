@@ -0,0 +1,178 @@
+/*
+ * File: uring.c
+ * Purpose: This file contains the io_uring wrapper.
+ *          Please see uring.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+/* This function enters the kernel to submit and/or wait.
+ */
+static int enter( uring *r, unsigned submit, unsigned min, unsigned flags,
+                  void *arg, size_t argsz ) {
+  return syscall( __NR_io_uring_enter, r->fd, submit, min, flags, arg, argsz );
+}
+
+
+extern int uring_init( uring *r, unsigned entries ) {
+  struct io_uring_params p;
+  char *sq;                                             /* submission ring */
+  char *cq;                                             /* completion ring */
+
+  memset( r, 0, sizeof( uring ) );
+  memset( &p, 0, sizeof( p ) );
+  r->fd = syscall( __NR_io_uring_setup, entries, &p );
+  if( r->fd < 0 ) {
+    return -1;
+  }
+  r->features = p.features;
+  r->entries = p.sq_entries;
+
+  r->sq_size = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+  r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof( struct io_uring_cqe );
+  r->sqes_size = p.sq_entries * sizeof( struct io_uring_sqe );
+  r->sq_ring = mmap( NULL, r->sq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING );
+  r->cq_ring = mmap( NULL, r->cq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING );
+  r->sqes = mmap( NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES );
+  if( r->sq_ring == MAP_FAILED || r->cq_ring == MAP_FAILED
+      || r->sqes == MAP_FAILED ) {
+    uring_exit( r );
+    return -1;
+  }
+
+  sq = r->sq_ring;
+  r->sq_head = (unsigned *)( sq + p.sq_off.head );
+  r->sq_tail = (unsigned *)( sq + p.sq_off.tail );
+  r->sq_mask = (unsigned *)( sq + p.sq_off.ring_mask );
+  r->sq_array = (unsigned *)( sq + p.sq_off.array );
+  cq = r->cq_ring;
+  r->cq_head = (unsigned *)( cq + p.cq_off.head );
+  r->cq_tail = (unsigned *)( cq + p.cq_off.tail );
+  r->cq_mask = (unsigned *)( cq + p.cq_off.ring_mask );
+  r->cqes = (struct io_uring_cqe *)( cq + p.cq_off.cqes );
+  return 0;
+}
+
+
+extern void uring_exit( uring *r ) {
+  if( r->sq_ring && r->sq_ring != MAP_FAILED ) {
+    munmap( r->sq_ring, r->sq_size );
+  }
+  if( r->cq_ring && r->cq_ring != MAP_FAILED ) {
+    munmap( r->cq_ring, r->cq_size );
+  }
+  if( r->sqes && r->sqes != MAP_FAILED ) {
+    munmap( r->sqes, r->sqes_size );
+  }
+  if( r->fd >= 0 ) {
+    close( r->fd );
+  }
+  memset( r, 0, sizeof( uring ) );
+  r->fd = -1;
+}
+
+
+extern int uring_register( uring *r, unsigned opcode, void *arg, unsigned nr ) {
+  return syscall( __NR_io_uring_register, r->fd, opcode, arg, nr );
+}
+
+
+extern int uring_supports( uring *r, int op ) {
+  char buf[sizeof( struct io_uring_probe ) + 256 * sizeof( struct io_uring_probe_op )];
+  struct io_uring_probe *probe = (struct io_uring_probe *)buf;
+
+  memset( buf, 0, sizeof( buf ) );
+  if( uring_register( r, IORING_REGISTER_PROBE, probe, 256 ) < 0 ) {
+    return 0;                                           /* kernel < 5.6 */
+  }
+  return op <= probe->last_op && ( probe->ops[op].flags & IO_URING_OP_SUPPORTED );
+}
+
+
+extern struct io_uring_sqe *uring_sqe( uring *r ) {
+  unsigned tail = *r->sq_tail;                          /* only we write it */
+  unsigned head = __atomic_load_n( r->sq_head, __ATOMIC_ACQUIRE );
+  struct io_uring_sqe *sqe;
+
+  if( tail - head >= r->entries ) {                     /* full, so flush */
+    uring_submit( r );
+    head = __atomic_load_n( r->sq_head, __ATOMIC_ACQUIRE );
+    if( tail - head >= r->entries ) {
+      return NULL;
+    }
+  }
+
+  sqe = &r->sqes[tail & *r->sq_mask];
+  memset( sqe, 0, sizeof( *sqe ) );
+  r->sq_array[tail & *r->sq_mask] = tail & *r->sq_mask;
+  return sqe;
+}
+
+
+extern void uring_queue( uring *r ) {
+  __atomic_store_n( r->sq_tail, *r->sq_tail + 1, __ATOMIC_RELEASE );
+}
+
+
+extern int uring_submit( uring *r ) {
+  unsigned queued = *r->sq_tail - __atomic_load_n( r->sq_head, __ATOMIC_ACQUIRE );
+  int n;
+
+  if( queued == 0 ) {
+    return 0;
+  }
+  do {
+    n = enter( r, queued, 0, 0, NULL, 0 );
+  } while( n < 0 && errno == EINTR );
+  return n;
+}
+
+
+extern int uring_wait( uring *r, unsigned min, int timeout ) {
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  unsigned queued = r->entries;                         /* whatever is there */
+  int n;
+
+  memset( &arg, 0, sizeof( arg ) );
+  arg.sigmask_sz = _NSIG / 8;
+  if( timeout >= 0 ) {
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = ( timeout % 1000 ) * 1000000L;
+    arg.ts = (unsigned long)&ts;
+  }
+
+  n = enter( r, queued, min, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+             &arg, sizeof( arg ) );
+  if( n < 0 && ( errno == ETIME || errno == EINTR ) ) {
+    return 0;                                           /* nothing ready */
+  }
+  return n < 0 ? -1 : 0;
+}
+
+
+extern struct io_uring_cqe *uring_peek( uring *r ) {
+  unsigned head = *r->cq_head;                          /* only we write it */
+
+  if( head == __atomic_load_n( r->cq_tail, __ATOMIC_ACQUIRE ) ) {
+    return NULL;
+  }
+  return &r->cqes[head & *r->cq_mask];
+}
+
+
+extern void uring_seen( uring *r ) {
+  __atomic_store_n( r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE );
+}
@@ -0,0 +1,148 @@
+/*
+ * File: uring.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          io_uring module, a thin wrapper over the raw io_uring system
+ *          calls that the network module uses as its alternative backend.
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/*
+ * This module has ten functions:
+ *   uring_init()     : create a ring
+ *   uring_exit()     : destroy a ring
+ *   uring_register() : register files or buffers with a ring
+ *   uring_supports() : check if the kernel supports an operation
+ *   uring_sqe()      : get a blank submission queue entry
+ *   uring_queue()    : queue the entry filled in after uring_sqe()
+ *   uring_submit()   : submit queued entries without waiting
+ *   uring_wait()     : submit queued entries and wait for completions
+ *   uring_peek()     : get the next completion, if any
+ *   uring_seen()     : consume the completion returned by uring_peek()
+ *
+ * Submission entries are queued in user space and are only handed to the
+ * kernel by uring_submit() or uring_wait(), so any number of operations
+ * can be issued with one system call.  Producers of entries must be
+ * serialized by the caller, but any thread may submit or wait, and
+ * completions may be reaped by one thread while others submit.
+ */
+
+typedef struct uring {
+  int fd;                               /* ring file descriptor */
+  unsigned features;                    /* IORING_FEAT_* of the kernel */
+  unsigned entries;                     /* size of the submission queue */
+  unsigned *sq_head;                    /* submission queue, shared with */
+  unsigned *sq_tail;                    /* the kernel */
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned *cq_head;                    /* completion queue, shared with */
+  unsigned *cq_tail;                    /* the kernel */
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+  void *sq_ring;                        /* mappings, for uring_exit() */
+  void *cq_ring;
+  size_t sq_size;
+  size_t cq_size;
+  size_t sqes_size;
+} uring;
+
+
+/* This function creates a ring.
+ * Parameters:
+ *             r       : the ring
+ *             entries : the size of the submission queue, a power of 2
+ * Returns: 0 on success, or -1 with errno set if the kernel does not
+ *          support io_uring or is out of resources.
+ */
+extern int uring_init( uring *r, unsigned entries );
+
+
+/* This function destroys a ring, abandoning operations in flight.
+ * Parameters:
+ *             r : the ring
+ * Returns: None
+ */
+extern void uring_exit( uring *r );
+
+
+/* This function calls io_uring_register() on a ring.
+ * Parameters:
+ *             r      : the ring
+ *             opcode : what to register, one of IORING_REGISTER_*
+ *             arg    : the argument of the opcode
+ *             nr     : the number of items in arg
+ * Returns: The result of the system call, -1 with errno set on error.
+ */
+extern int uring_register( uring *r, unsigned opcode, void *arg, unsigned nr );
+
+
+/* This function checks if the kernel supports an operation.
+ * Parameters:
+ *             r  : the ring
+ *             op : the operation, one of IORING_OP_*
+ * Returns: 1 if the operation is supported, 0 if not.
+ */
+extern int uring_supports( uring *r, int op );
+
+
+/* This function gets a blank submission queue entry.  If the queue is
+ *    full, the queued entries are submitted first.  The entry is not seen
+ *    by the kernel until it is filled in and passed to uring_queue().
+ * Parameters:
+ *             r : the ring
+ * Returns: The entry, zeroed, or NULL if the queue stays full.
+ */
+extern struct io_uring_sqe *uring_sqe( uring *r );
+
+
+/* This function queues the entry returned by the last uring_sqe(), to be
+ *    submitted by the next uring_submit() or uring_wait().
+ * Parameters:
+ *             r : the ring
+ * Returns: None
+ */
+extern void uring_queue( uring *r );
+
+
+/* This function submits all queued entries without waiting.
+ * Parameters:
+ *             r : the ring
+ * Returns: The number of entries submitted, or -1 with errno set.
+ */
+extern int uring_submit( uring *r );
+
+
+/* This function submits all queued entries and waits for completions.
+ * Parameters:
+ *             r       : the ring
+ *             min     : the number of completions to wait for
+ *             timeout : milliseconds to wait, or -1 to wait forever; it
+ *                       requires IORING_FEAT_EXT_ARG
+ * Returns: 0 once there are completions or on timeout, or -1 with errno
+ *          set.
+ */
+extern int uring_wait( uring *r, unsigned min, int timeout );
+
+
+/* This function gets the next completion.
+ * Parameters:
+ *             r : the ring
+ * Returns: The completion, which stays valid until uring_seen(), or NULL if
+ *          there are none.
+ */
+extern struct io_uring_cqe *uring_peek( uring *r );
+
+
+/* This function consumes the completion returned by uring_peek().
+ * Parameters:
+ *             r : the ring
+ * Returns: None
+ */
+extern void uring_seen( uring *r );
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ * File: wheel.c
+ * Purpose: This file contains the timer wheel.
+ *          Please see wheel.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "wheel.h"
+
+
+/* This function puts a timer in the slot its deadline falls in.
+ * Parameters:
+ *             w : the wheel
+ *             t : a timer that is in no slot
+ * Returns: None
+ */
+static void place( wheel *w, timer *t ) {
+  uint64_t delta = t->expires > w->now ? t->expires - w->now : 0;
+  uint64_t when = t->expires > w->now ? t->expires : w->now;
+  int level;
+
+  for( level = 0; level < WHEEL_LEVELS - 1; level++ ) {
+    if( delta < ( 1ull << ( WHEEL_BITS * ( level + 1 ) ) ) ) {
+      break;
+    }
+  }
+  if( delta >= ( 1ull << ( WHEEL_BITS * WHEEL_LEVELS ) ) ) {
+    when = w->now + ( 1ull << ( WHEEL_BITS * WHEEL_LEVELS ) ) - 1;  /* far off */
+  }
+  if( delta == 0 ) {
+    when = w->now + 1;                                  /* next tick */
+  }
+
+  t->slot = &w->slots[level][( when >> ( WHEEL_BITS * level ) ) & ( WHEEL_SLOTS - 1 )];
+  t->prev = NULL;
+  t->next = *t->slot;
+  if( t->next ) {
+    t->next->prev = t;
+  }
+  *t->slot = t;
+}
+
+
+extern void wheel_init( wheel *w, uint64_t now, int tick ) {
+  memset( w, 0, sizeof( wheel ) );
+  w->tick = tick;
+  w->now = now / tick;
+}
+
+
+extern void wheel_remove( wheel *w, timer *t ) {
+  if( !t->slot ) {
+    return;                                             /* not set */
+  }
+  if( t->prev ) {
+    t->prev->next = t->next;
+  } else {
+    *t->slot = t->next;
+  }
+  if( t->next ) {
+    t->next->prev = t->prev;
+  }
+  t->slot = NULL;
+  t->next = t->prev = NULL;
+}
+
+
+extern void wheel_add( wheel *w, timer *t, uint64_t deadline ) {
+  wheel_remove( w, t );
+  t->expires = ( deadline + w->tick - 1 ) / w->tick;    /* round up */
+  place( w, t );
+}
+
+
+extern timer *wheel_expire( wheel *w, uint64_t now ) {
+  timer *expired = NULL;                                /* list to return */
+  timer *t;
+  timer *next;
+  int level;
+  int index;
+
+  for( now /= w->tick; w->now < now; ) {
+    w->now++;
+
+    // when a level comes round, the next slot up moves down a level
+    for( level = 1; level < WHEEL_LEVELS; level++ ) {
+      if( w->now & ( ( 1ull << ( WHEEL_BITS * level ) ) - 1 ) ) {
+        break;
+      }
+      index = ( w->now >> ( WHEEL_BITS * level ) ) & ( WHEEL_SLOTS - 1 );
+      t = w->slots[level][index];
+      w->slots[level][index] = NULL;
+      for( ; t; t = next ) {
+        next = t->next;
+        place( w, t );
+      }
+    }
+
+    t = w->slots[0][w->now & ( WHEEL_SLOTS - 1 )];
+    w->slots[0][w->now & ( WHEEL_SLOTS - 1 )] = NULL;
+    for( ; t; t = next ) {
+      next = t->next;
+      if( t->expires > w->now ) {                       /* a far off timer */
+        place( w, t );                                  /* came round early */
+        continue;
+      }
+      t->slot = NULL;
+      t->prev = NULL;
+      t->next = expired;
+      expired = t;
+    }
+  }
+  return expired;
+}
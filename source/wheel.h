@@ -0,0 +1,92 @@
+/*
+ * File: wheel.h
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          timer wheel, which keeps the deadlines of the connections.
+ */
+
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <stdint.h>
+
+/*
+ * This module has four functions:
+ *   wheel_init()   : initialize an empty wheel
+ *   wheel_add()    : set the deadline of a timer
+ *   wheel_remove() : cancel a timer
+ *   wheel_expire() : take the timers whose deadline has passed
+ *
+ * A wheel is a hierarchy of WHEEL_LEVELS rings of WHEEL_SLOTS lists.  Time
+ * is counted in ticks of tick milliseconds.  Level 0 has one slot per tick
+ * for the next WHEEL_SLOTS ticks, level 1 one slot per WHEEL_SLOTS ticks,
+ * and so on.  Adding or removing a timer is O(1), since it is a list
+ * operation on the slot its deadline falls in.  As time passes, the timers
+ * of a higher level slot are moved down a level when level 0 comes round,
+ * so each timer is moved at most WHEEL_LEVELS - 1 times.  Deadlines are
+ * rounded up to a tick, and deadlines past the top level are kept in its
+ * last slot and moved again when it comes round.
+ *
+ * Timers are embedded in the objects they belong to, so the wheel never
+ * allocates memory.  A wheel is not thread safe; the caller must hold its
+ * own lock.
+ */
+
+#define WHEEL_BITS 6                            /* log2 of WHEEL_SLOTS */
+#define WHEEL_SLOTS ( 1 << WHEEL_BITS )         /* slots per level */
+#define WHEEL_LEVELS 4                          /* 2^24 ticks in all */
+
+typedef struct timer {
+  struct timer *next;                   /* next timer of the slot */
+  struct timer *prev;                   /* previous one, NULL if first */
+  struct timer **slot;                  /* head of its slot, NULL if idle */
+  uint64_t expires;                     /* deadline in ticks */
+  void *owner;                          /* the object the timer belongs to */
+} timer;
+
+typedef struct wheel {
+  uint64_t now;                         /* ticks expired so far */
+  int tick;                             /* milliseconds per tick */
+  timer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+} wheel;
+
+
+/* This function initializes an empty wheel.
+ * Parameters:
+ *             w    : the wheel
+ *             now  : the time in milliseconds
+ *             tick : milliseconds per tick
+ * Returns: None
+ */
+extern void wheel_init( wheel *w, uint64_t now, int tick );
+
+
+/* This function sets the deadline of a timer, cancelling any deadline it
+ *    had before.
+ * Parameters:
+ *             w        : the wheel
+ *             t        : the timer, zeroed before its first use
+ *             deadline : the time in milliseconds at which it expires
+ * Returns: None
+ */
+extern void wheel_add( wheel *w, timer *t, uint64_t deadline );
+
+
+/* This function cancels a timer.  It does nothing if the timer is not set.
+ * Parameters:
+ *             w : the wheel
+ *             t : the timer
+ * Returns: None
+ */
+extern void wheel_remove( wheel *w, timer *t );
+
+
+/* This function advances a wheel to the current time and removes the timers
+ *    that have expired.
+ * Parameters:
+ *             w   : the wheel
+ *             now : the time in milliseconds
+ * Returns: The expired timers, linked by next, or NULL if there are none.
+ */
+extern timer *wheel_expire( wheel *w, uint64_t now );
+
+#endif